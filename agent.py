@@ -40,54 +40,288 @@ class SimpleGreedyAgent(Agent):
         self.action = random.choice(max_actions)
 
 
+# MAX_LEGAL_ACTIONS in plugin/chess.hpp, no position has more legal actions
+MAX_ACTIONS_CNT = 800
+
+# flat cells of the board_status keys, in the order Board creates them
+_status_keys = None
+_status_cells = None
+
+
+def toChess(board_status):
+    global _status_keys, _status_cells
+    keys = tuple(board_status)
+    if keys != _status_keys:
+        _status_keys = keys
+        _status_cells = np.array([pos2idx[pos[0], pos[1]][0] * 10 + pos2idx[pos[0], pos[1]][1] for pos in keys])
+    chess = np.zeros(100, dtype=np.int32)
+    chess[_status_cells] = np.fromiter(board_status.values(), dtype=np.int32, count=len(keys))
+    return chess.reshape((10, 10))
+
+
+class BatchPlugin(object):
+    # many positions per call, run in parallel inside the plugin.
+    # boards is an (n, 10, 10) int32 array and players an (n,) int32 array, used without copying if contiguous.
+    def __init__(self):
+        self.plugin = ct.load_library("libplugin", "./plugin/lib")
+        self.plugin.get_actions_batch.argtypes = [
+            c_int32,
+            ct.ndpointer(np.int32, 3, flags="C_CONTIGUOUS"),
+            ct.ndpointer(np.int32, 1, flags="C_CONTIGUOUS"),
+            ct.ndpointer(np.int32, 3, flags="C_CONTIGUOUS"),
+            c_int32,
+            ct.ndpointer(np.int32, 1, flags="C_CONTIGUOUS"),
+        ]
+        self.plugin.get_actions_batch.restype = c_int32
+        self.plugin.evaluate_batch.argtypes = [
+            c_int32,
+            ct.ndpointer(np.int32, 3, flags="C_CONTIGUOUS"),
+            ct.ndpointer(np.int32, 1, flags="C_CONTIGUOUS"),
+            ct.ndpointer(np.int32, 1, flags="C_CONTIGUOUS"),
+        ]
+
+    def actions(self, boards, players, expected_actions_cnt=64):
+        # returns actions of shape (total, 2, 2) and offsets, the actions of board i are actions[offsets[i]:offsets[i + 1]]
+        boards = np.ascontiguousarray(boards, dtype=np.int32)
+        players = np.ascontiguousarray(players, dtype=np.int32)
+        n = len(boards)
+        offsets = np.zeros(n + 1, dtype=np.int32)
+        actions = np.zeros((max(n * expected_actions_cnt, 1), 2, 2), dtype=np.int32)
+        cnt = self.plugin.get_actions_batch(c_int32(n), boards, players, actions, c_int32(len(actions)), offsets)
+        if cnt < 0:
+            # offsets tell how many there are
+            actions = np.zeros((max(offsets[n], 1), 2, 2), dtype=np.int32)
+            cnt = self.plugin.get_actions_batch(c_int32(n), boards, players, actions, c_int32(len(actions)), offsets)
+        return actions[:cnt], offsets
+
+    def evaluate(self, boards, players):
+        boards = np.ascontiguousarray(boards, dtype=np.int32)
+        players = np.ascontiguousarray(players, dtype=np.int32)
+        values = np.zeros(len(boards), dtype=np.int32)
+        self.plugin.evaluate_batch(c_int32(len(boards)), boards, players, values)
+        return values
+
+
+# mirror of search_stats_t in plugin/chess.hpp
+class SearchStats(Structure):
+    _fields_ = [
+        ("nodes", c_uint64),
+        ("leaves", c_uint64),
+        ("beta_cutoffs", c_uint64),
+        ("first_move_cutoffs", c_uint64),
+        ("tt_probes", c_uint64),
+        ("tt_hits", c_uint64),
+        ("re_searches", c_uint64),
+        ("completed_depth", c_int32),
+        ("first_move_cutoff_rate", c_double),
+        ("effective_branching_factor", c_double),
+        ("total_ms", c_double),
+        ("depth_ms", c_double * 64),
+        ("depth_nodes", c_uint64 * 64),
+        ("race_nodes", c_uint64),
+        ("ponder_depth", c_int32),
+        ("book_move", c_int32),
+        ("reductions", c_uint64),
+        ("futility_prunes", c_uint64),
+        ("probcut_cutoffs", c_uint64),
+    ]
+
+
+# mirror of dynamic_pool_stats in plugin/thread_pools/includes/dynamic_pool.hpp
+class PoolStats(Structure):
+    _fields_ = [
+        ("queue_depth", c_uint64),
+        ("workers", c_uint64),
+        ("active_workers", c_uint64),
+        ("peak_workers", c_uint64),
+        ("started_workers", c_uint64),
+        ("retired_workers", c_uint64),
+        ("completed_tasks", c_uint64),
+        ("mean_wait_ms", c_double),
+        ("max_wait_ms", c_double),
+        ("mean_run_ms", c_double),
+    ]
+
+
+# mirror of engine_config_t in plugin/plugin.cpp
+class EngineConfig(Structure):
+    _fields_ = [
+        ("player", c_int32),
+        ("max_search_depth", c_int32),
+        ("max_search_depth_without_opponent", c_int32),
+        ("max_search_actions_cnt", c_int32),
+        ("enable_sort_actions", c_int32),
+        ("enable_without_opponent", c_int32),
+        ("tt_size_mb", c_int32),
+        ("search_mode", c_int32),
+        ("max_pool_tasks", c_int32),
+        ("seed", c_uint32),
+        ("enable_lmr", c_int32),
+        ("enable_futility", c_int32),
+        ("enable_probcut", c_int32),
+    ]
+
+
 class XinMinimaxAgent(Agent):
     def __init__(self, game, player,
                  max_search_depth=4,
                  max_search_depth_without_opponent=3,
                  max_search_actions_cnt=32,
                  enable_sort_actions=True,
-                 enable_without_opponent=True):
+                 enable_without_opponent=True,
+                 tt_size_mb=16,
+                 search_time_ms=0,
+                 search_mode=0,
+                 endgame_db=None,
+                 opening_book=None,
+                 ponder=False,
+                 pool_max_workers=0,
+                 pool_idle_workers=0,
+                 pool_idle_timeout_ms=1000,
+                 max_pool_tasks=0,
+                 seed=0,
+                 enable_lmr=False,
+                 enable_futility=False,
+                 enable_probcut=False):
         super(XinMinimaxAgent, self).__init__(game)
         self.player = player
+        # ponder: keep searching in the background while the opponent thinks
+        self.ponder = ponder
+        # search_mode: 0 single thread, 1 young brothers wait, 2 lazy smp
+        # search_time_ms > 0 switches to iterative deepening within that budget
+        # max_pool_tasks > 0 caps the threads this agent takes from the pool shared by all agents
+        # seed != 0 repeats the choices between equally good actions
+        # enable_lmr, enable_futility, enable_probcut: search late or hopeless actions shallower or not at all,
+        # so that max_search_actions_cnt can stay large
+        self.search_time_ms = search_time_ms
         self.plugin = ct.load_library("libplugin", "./plugin/lib")
-        self.plugin.alpha_beta_minmax.argtypes = [
-            c_int32,
+        self.plugin.create_engine.argtypes = [POINTER(EngineConfig)]
+        self.plugin.create_engine.restype = c_void_p
+        self.plugin.destroy_engine.argtypes = [c_void_p]
+        self.plugin.engine_move.argtypes = [
+            c_void_p,
             ct.ndpointer(np.int32, 2, (10, 10), "C_CONTIGUOUS"),
+            c_int32,
             ct.ndpointer(np.int32, 2, (2, 2), "C_CONTIGUOUS"),
         ]
-        self.plugin.init_agent.argtypes = [
-            c_int32, c_int32, c_int32, c_int32, c_bool, c_bool
-        ]
+        self.plugin.engine_start_ponder.argtypes = [c_void_p, ct.ndpointer(np.int32, 2, (10, 10), "C_CONTIGUOUS")]
+        self.plugin.engine_stop_ponder.argtypes = [c_void_p]
+        self.plugin.engine_search_stats.argtypes = [c_void_p, POINTER(SearchStats)]
+        self.plugin.engine_set_search_pool.argtypes = [c_void_p, c_int32, c_int32, c_int32]
+        self.plugin.engine_pool_stats.argtypes = [c_void_p, POINTER(PoolStats)]
+        self.plugin.load_endgame_db.argtypes = [c_char_p]
+        self.plugin.load_endgame_db.restype = c_bool
+        self.plugin.load_opening_book.argtypes = [c_char_p]
+        self.plugin.load_opening_book.restype = c_bool
         self.plugin.get_actions.argtypes = [
             c_int32,
             ct.ndpointer(np.int32, 2, (10, 10), "C_CONTIGUOUS"),
-            ct.ndpointer(np.int32, 3, (200, 2, 2), "C_CONTIGUOUS"),
+            ct.ndpointer(np.int32, 3, flags="C_CONTIGUOUS"),
+            c_int32,
             POINTER(c_int32)
         ]
-        self.plugin.init_agent(
-            c_int32(player), c_int32(max_search_depth),
-            c_int32(max_search_depth_without_opponent),
-            c_int32(max_search_actions_cnt),
-            c_bool(enable_sort_actions),
-            c_bool(enable_without_opponent))
+        # an engine of its own, any number of agents can play in one process
+        config = EngineConfig(player=player,
+                              max_search_depth=max_search_depth,
+                              max_search_depth_without_opponent=max_search_depth_without_opponent,
+                              max_search_actions_cnt=max_search_actions_cnt,
+                              enable_sort_actions=enable_sort_actions,
+                              enable_without_opponent=enable_without_opponent,
+                              tt_size_mb=tt_size_mb,
+                              search_mode=search_mode,
+                              max_pool_tasks=max_pool_tasks,
+                              seed=seed,
+                              enable_lmr=enable_lmr,
+                              enable_futility=enable_futility,
+                              enable_probcut=enable_probcut)
+        self.engine = self.plugin.create_engine(pointer(config))
+        assert self.engine, "player must be 1 or 2"
+        # pool_max_workers > 0: threads of this agent come from a pool of its own that grows up to
+        # pool_max_workers and shrinks back to pool_idle_workers, for a process serving many games
+        self.plugin.engine_set_search_pool(self.engine, c_int32(pool_max_workers), c_int32(pool_idle_workers),
+                                           c_int32(pool_idle_timeout_ms))
+        # table written by plugin/build/endgame_gen, shared by both players
+        if endgame_db is not None and not self.plugin.load_endgame_db(endgame_db.encode()):
+            print("endgame table %s not loaded" % endgame_db)
+        # book written by plugin/build/book_gen, shared by both players
+        if opening_book is not None and not self.plugin.load_opening_book(opening_book.encode()):
+            print("opening book %s not loaded" % opening_book)
         self.getAction((player, self.game.startState()[1]))
 
+    def __del__(self):
+        if getattr(self, "engine", None):
+            self.plugin.destroy_engine(self.engine)
+            self.engine = None
+
     @nb.jit(forceobj=True)
     def getAction(self, state):
         assert self.player == state[0], "player id does not match agent's id"
-        chess = np.zeros((10, 10), dtype=np.int32)
-        for pos, v in state[1].board_status.items():
-            x, y = pos2idx[pos[0], pos[1]]
-            chess[x, y] = v
+        chess = toChess(state[1].board_status)
 
         # for debug
-        # my_actions = np.zeros([200, 2, 2], dtype=np.int32)
+        # my_actions = np.zeros([MAX_ACTIONS_CNT, 2, 2], dtype=np.int32)
         # my_actions_cnt = c_int32(0)
-        # self.plugin.get_actions(c_int32(state[0]), chess, my_actions, pointer(my_actions_cnt))
+        # self.plugin.get_actions(c_int32(state[0]), chess, my_actions, c_int32(MAX_ACTIONS_CNT),
+        #                         pointer(my_actions_cnt))
         # assert my_actions_cnt.value == len(self.game.actions(state))
 
         best_action = np.zeros((2, 2), dtype=np.int32)
-        self.plugin.alpha_beta_minmax(c_int32(state[0]), chess, best_action, )
+        self.plugin.engine_move(self.engine, chess, c_int32(self.search_time_ms), best_action)
+        if self.ponder:
+            # stopped by the next getAction
+            chess[best_action[1][0], best_action[1][1]] = chess[best_action[0][0], best_action[0][1]]
+            chess[best_action[0][0], best_action[0][1]] = 0
+            self.plugin.engine_start_ponder(self.engine, chess)
+        begin, end = best_action
+        begin = tuple(idx2pos[begin[0], begin[1]].tolist())
+        end = tuple(idx2pos[end[0], end[1]].tolist())
+        self.action = (begin, end)
+
+    def stopPonder(self):
+        # call once the game is over
+        self.plugin.engine_stop_ponder(self.engine)
+
+    def searchStats(self):
+        # counters of the last getAction
+        stats = SearchStats()
+        self.plugin.engine_search_stats(self.engine, pointer(stats))
+        return stats
+
+    def poolStats(self):
+        # queue depth, workers and task latency of the pool of pool_max_workers, zero on the shared pool
+        stats = PoolStats()
+        self.plugin.engine_pool_stats(self.engine, pointer(stats))
+        return stats
+
+
+class XinMCTSAgent(Agent):
+    def __init__(self, game, player,
+                 max_iterations=20000,
+                 max_nodes=1 << 20,
+                 search_time_ms=0,
+                 parallel_mode=0):
+        super(XinMCTSAgent, self).__init__(game)
+        self.player = player
+        # parallel_mode: 0 one tree with virtual loss, 1 one tree per thread
+        # search_time_ms > 0 searches within that budget instead of max_iterations
+        self.search_time_ms = search_time_ms
+        self.plugin = ct.load_library("libplugin", "./plugin/lib")
+        self.plugin.mcts_search.argtypes = [
+            c_int32,
+            ct.ndpointer(np.int32, 2, (10, 10), "C_CONTIGUOUS"),
+            c_int32,
+            ct.ndpointer(np.int32, 2, (2, 2), "C_CONTIGUOUS"),
+        ]
+        self.plugin.init_mcts_agent.argtypes = [c_int32, c_int32, c_int32, c_int32]
+        self.plugin.init_mcts_agent(c_int32(player), c_int32(max_iterations), c_int32(max_nodes),
+                                    c_int32(parallel_mode))
+
+    def getAction(self, state):
+        assert self.player == state[0], "player id does not match agent's id"
+        chess = toChess(state[1].board_status)
+
+        best_action = np.zeros((2, 2), dtype=np.int32)
+        self.plugin.mcts_search(c_int32(state[0]), chess, c_int32(self.search_time_ms), best_action)
         begin, end = best_action
         begin = tuple(idx2pos[begin[0], begin[1]].tolist())
         end = tuple(idx2pos[end[0], end[1]].tolist())
@@ -0,0 +1,278 @@
+#include "chess.hpp"
+#include "mcts.hpp"
+#include "game_rules.hpp"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <memory>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+
+struct engine_config_t {
+    std::string name;
+    std::string engine{"minmax"};
+    int depth{4};
+    int wo_depth{3};
+    int actions{32};
+    bool sort{true};
+    bool wo{true};
+    int mode{0};
+    int tt_mb{16};
+    bool pvs{true};
+    bool lmr{false};
+    bool futility{false};
+    bool probcut{false};
+    bool race{true};
+    bool book{true}; // play from the book of --book
+    int budget_ms{0}; // 0 searches to the fixed depth, or for the fixed iterations of mcts
+    int iterations{static_cast<int>(DEFAULT_MCTS_ITERATIONS)};
+};
+
+class engine_t {
+public:
+    virtual ~engine_t() = default;
+
+    virtual action_t act(const board_t &board) = 0;
+};
+
+class minmax_engine_t : public engine_t {
+private:
+    MinMaxAgent _agent;
+    const int _budget_ms;
+
+public:
+    minmax_engine_t(int player, const engine_config_t &config) : _agent(player), _budget_ms(config.budget_ms) {
+        _agent.max_search_depth = config.depth;
+        _agent.max_search_depth_without_opponent = config.wo_depth;
+        _agent.max_search_actions_cnt = config.actions;
+        _agent.enable_sort_actions = config.sort;
+        _agent.enable_without_opponent = config.wo;
+        _agent.search_mode = static_cast<search_mode_t>(config.mode);
+        _agent.enable_pvs = config.pvs;
+        _agent.enable_lmr = config.lmr;
+        _agent.enable_futility = config.futility;
+        _agent.enable_probcut = config.probcut;
+        _agent.enable_race_solver = config.race;
+        _agent.enable_opening_book = config.book;
+        _agent.set_tt_size(config.tt_mb);
+    }
+
+    action_t act(const board_t &board) override {
+        auto[val, action] = _budget_ms > 0 ? _agent.run_timed(board, std::chrono::milliseconds(_budget_ms))
+                                           : _agent.run(board);
+        return action;
+    }
+};
+
+class mcts_engine_t : public engine_t {
+private:
+    MCTSAgent _agent;
+    const int _budget_ms;
+
+public:
+    mcts_engine_t(int player, const engine_config_t &config) : _agent(player), _budget_ms(config.budget_ms) {
+        _agent.max_iterations = config.iterations;
+        _agent.parallel_mode = static_cast<mcts_parallel_t>(config.mode);
+        // games already run one per core
+        _agent.helpers_cnt = 0;
+    }
+
+    action_t act(const board_t &board) override {
+        auto[val, action] = _budget_ms > 0 ? _agent.run_timed(board, std::chrono::milliseconds(_budget_ms))
+                                           : _agent.run(board);
+        return action;
+    }
+};
+
+static std::unique_ptr<engine_t> make_engine(int player, const engine_config_t &config) {
+    if (config.engine == "mcts") return std::unique_ptr<engine_t>(new mcts_engine_t(player, config));
+    return std::unique_ptr<engine_t>(new minmax_engine_t(player, config));
+}
+
+// key=value pairs separated by commas, false on an unknown key
+static bool parse_config(const std::string &spec, engine_config_t &config) {
+    config.name = spec;
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        auto pos = item.find('=');
+        if (pos == std::string::npos) return false;
+        const std::string key = item.substr(0, pos), value = item.substr(pos + 1);
+        const int v = std::atoi(value.c_str());
+        if (key == "engine") config.engine = value;
+        else if (key == "depth") config.depth = v;
+        else if (key == "wo-depth") config.wo_depth = v;
+        else if (key == "actions") config.actions = v;
+        else if (key == "sort") config.sort = v != 0;
+        else if (key == "wo") config.wo = v != 0;
+        else if (key == "mode") config.mode = v;
+        else if (key == "tt") config.tt_mb = v;
+        else if (key == "pvs") config.pvs = v != 0;
+        else if (key == "lmr") config.lmr = v != 0;
+        else if (key == "futility") config.futility = v != 0;
+        else if (key == "probcut") config.probcut = v != 0;
+        else if (key == "race") config.race = v != 0;
+        else if (key == "book") config.book = v != 0;
+        else if (key == "budget") config.budget_ms = v;
+        else if (key == "iterations") config.iterations = v;
+        else return false;
+    }
+    return config.engine == "minmax" || config.engine == "mcts";
+}
+
+struct game_result_t {
+    int winner_engine{-1}; // 0 for engine a, 1 for engine b, -1 for a draw
+    int steps{0};
+    std::vector<double> move_ms[2]; // latency of every action of engine a and b
+};
+
+// engine a plays player 1 in even games. the two games of a pair start with the same random opening.
+static game_result_t play_game(const engine_config_t configs[2], int game, int opening_plies, unsigned seed) {
+    const int a_player = game % 2 == 0 ? 1 : 2;
+    std::unique_ptr<engine_t> engines[2] = {make_engine(1, configs[a_player == 1 ? 0 : 1]),
+                                            make_engine(2, configs[a_player == 1 ? 1 : 0])};
+    std::minstd_rand opening_rng(seed + game / 2);
+
+    int chess[BOARD_SIZE][BOARD_SIZE];
+    std::memcpy(chess, start_chess.value, sizeof(chess));
+    board_t board = to_board(chess);
+    game_result_t result;
+    int player = 1;
+    for (int step = 1; step <= MAX_STEPS; step++) {
+        const int engine_index = player == a_player ? 0 : 1;
+        action_t action;
+        if (step <= opening_plies) {
+            action_list_t actions;
+            generate_actions(player, board, actions);
+            if (actions.size() == 0) break;
+            action = actions[std::uniform_int_distribution<std::size_t>(0, actions.size() - 1)(opening_rng)];
+        } else {
+            const auto start = std::chrono::steady_clock::now();
+            action = engines[player - 1]->act(board);
+            result.move_ms[engine_index].push_back(std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start).count());
+        }
+        apply_action(board, action);
+        result.steps = step;
+        int winner = python_winner(board, step);
+        if (winner) {
+            result.winner_engine = winner == a_player ? 0 : 1;
+            break;
+        }
+        player = 3 - player;
+    }
+    return result;
+}
+
+static double percentile(std::vector<double> &values, double p) {
+    if (values.empty()) return 0;
+    std::size_t k = std::min(values.size() - 1, (std::size_t) (p * (values.size() - 1) + 0.5));
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+
+int main(int argc, char *argv[]) {
+    engine_config_t configs[2];
+    configs[0].name = configs[1].name = "default";
+    int games = 100, opening_plies = 2;
+    unsigned threads_cnt = std::max(std::thread::hardware_concurrency(), 1u);
+    unsigned seed = std::random_device{}();
+    bool csv = false;
+    for (int i = 1; i < argc; i++) {
+        bool ok = true;
+        if (strcmp("--a", argv[i]) == 0 && i + 1 < argc) {
+            ok = parse_config(argv[++i], configs[0]);
+        } else if (strcmp("--b", argv[i]) == 0 && i + 1 < argc) {
+            ok = parse_config(argv[++i], configs[1]);
+        } else if (strcmp("--games", argv[i]) == 0 && i + 1 < argc) {
+            games = std::max(std::atoi(argv[++i]), 1);
+        } else if (strcmp("--threads", argv[i]) == 0 && i + 1 < argc) {
+            threads_cnt = std::max(std::atoi(argv[++i]), 1);
+        } else if (strcmp("--opening-plies", argv[i]) == 0 && i + 1 < argc) {
+            opening_plies = std::max(std::atoi(argv[++i]), 0);
+        } else if (strcmp("--seed", argv[i]) == 0 && i + 1 < argc) {
+            seed = (unsigned) std::atoll(argv[++i]);
+        } else if (strcmp("--book", argv[i]) == 0 && i + 1 < argc) {
+            ok = open_opening_book(argv[++i]);
+            if (!ok) std::cerr << "[ERROR]: can not open the book " << argv[i] << std::endl;
+        } else if (strcmp("--csv", argv[i]) == 0) {
+            csv = true;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            std::cout << "usage: " << argv[0] << " [--a config] [--b config] [--games n, default=100]"
+                      << " [--threads n, default=cores] [--opening-plies n, default=2] [--seed n] [--book path] [--csv]\n"
+                      << "config: comma separated key=value of engine=minmax|mcts, depth, wo-depth, actions, sort,"
+                      << " wo, mode, tt, pvs, lmr, futility, probcut, race, book (use the --book),"
+                      << " budget (ms, 0 for fixed depth), iterations" << std::endl;
+            return -1;
+        }
+    }
+
+    std::vector<game_result_t> results(games);
+    std::atomic<int> next_game{0};
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < std::min<unsigned>(threads_cnt, games); t++) {
+        threads.emplace_back([&]() {
+            for (int game; (game = next_game.fetch_add(1)) < games;) {
+                results[game] = play_game(configs, game, opening_plies, seed);
+            }
+        });
+    }
+    for (auto &thread : threads) thread.join();
+
+    int wins[2] = {0, 0}, draws = 0;
+    double steps = 0;
+    std::vector<double> move_ms[2];
+    for (auto &result : results) {
+        if (result.winner_engine < 0) draws++;
+        else wins[result.winner_engine]++;
+        steps += result.steps;
+        for (int i = 0; i < 2; i++) move_ms[i].insert(move_ms[i].end(), result.move_ms[i].begin(), result.move_ms[i].end());
+    }
+
+    // score of engine a, a draw counts half, with the 95% wilson interval that stays sane at 0 and 1
+    const double n = games, z = 1.96;
+    const double score = (wins[0] + 0.5 * draws) / n;
+    const double center = (score + z * z / (2 * n)) / (1 + z * z / n);
+    const double margin = z * std::sqrt(score * (1 - score) / n + z * z / (4 * n * n)) / (1 + z * z / n);
+    auto elo = [](double s) {
+        s = std::min(std::max(s, 1e-3), 1 - 1e-3);
+        return -400 * std::log10(1 / s - 1);
+    };
+
+    auto report = [&](const std::string &who, const std::string &metric, double value) {
+        if (csv) {
+            std::cout << who << "," << metric << "," << std::fixed << std::setprecision(3) << value << std::endl;
+        } else {
+            std::cout << std::left << std::setw(10) << who << std::setw(14) << metric << std::fixed
+                      << std::setprecision(3) << value << std::endl;
+        }
+    };
+    if (csv) std::cout << "engine,metric,value" << std::endl;
+    else std::cout << "a: " << configs[0].name << "\nb: " << configs[1].name << std::endl;
+    report("games", "count", games);
+    report("games", "draws", draws);
+    report("games", "avg-steps", steps / n);
+    report("a", "wins", wins[0]);
+    report("a", "score", score);
+    report("a", "score-low", center - margin);
+    report("a", "score-high", center + margin);
+    report("a", "elo", elo(score));
+    report("a", "elo-low", elo(center - margin));
+    report("a", "elo-high", elo(center + margin));
+    report("b", "wins", wins[1]);
+    const char *names[2] = {"a", "b"};
+    for (int i = 0; i < 2; i++) {
+        report(names[i], "move-ms-p50", percentile(move_ms[i], 0.5));
+        report(names[i], "move-ms-p90", percentile(move_ms[i], 0.9));
+        report(names[i], "move-ms-p99", percentile(move_ms[i], 0.99));
+        report(names[i], "move-ms-max", percentile(move_ms[i], 1));
+    }
+    return 0;
+}
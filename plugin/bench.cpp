@@ -0,0 +1,452 @@
+#include "chess.hpp"
+#include "evaluation.hpp"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <cstdlib>
+#include <algorithm>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// positions taken from self-play games, perft counts from the reference get_legal_action
+struct bench_position_t {
+    const char *name;
+    int player;
+    const char *cells; // chess values in row-major order
+    std::uint64_t perft[4]; // leaf count of depth 1 to 4
+};
+
+static constexpr int MAX_PERFT_DEPTH = 4;
+
+static_assert(BOARD_SIZE == 10 && geometry::PIECE_ROWS == 4, "the positions are of the standard board");
+
+// keeps the timed loops from being optimized away
+static volatile long long sink = 0;
+
+static const bench_position_t positions[] = {
+        {"start",    1, "2422000000442000000022000000002000000000000000000000000000000000000001000000001100000001330000001131",
+                {14,  196,   4872,    121104}},
+        {"opening",  1, "0400020000000400000002000000002000000001002000000304000000110220000100200001003100000000000000100030",
+                {76,  6064,  440715,  34227258}},
+        {"middle-1", 1, "0000000100000100200000000000000201200433000000000000000000000002000120110001002400002004000030000000",
+                {140, 16384, 1854595, 206771753}},
+        {"middle-2", 2, "0000000100000100200000000000000201200433000000000000000000000002001020110001002400002004000030000000",
+                {106, 11733, 1258172, 137458851}},
+        {"late",     1, "1300000000011000000000100000003100000000000001040010200000000000002002000000002000000200043002000402",
+                {77,  5485,  429476,  31408465}},
+        {"race",     1, "3101001110310000000000000000200000010000000000002000000040000000000000000002000403000022400002002000",
+                {47,  4301,  219647,  19899773}},
+};
+
+static board_t to_board(const bench_position_t &position) {
+    int chess[BOARD_SIZE][BOARD_SIZE];
+    for (int cell = 0; cell < CELL_CNT; cell++) {
+        chess[cell / BOARD_SIZE][cell % BOARD_SIZE] = position.cells[cell] - '0';
+    }
+    return to_board(chess);
+}
+
+static std::uint64_t perft(int player, const board_t &board, int depth) {
+    action_list_t actions;
+    generate_actions(player, board, actions);
+    if (depth == 1) return actions.size();
+    std::uint64_t leaves = 0;
+    for (const auto &action : actions) {
+        board_t next = board;
+        apply_action(next, action);
+        leaves += perft(3 - player, next, depth - 1);
+    }
+    return leaves;
+}
+
+static bool same_actions(const std::vector<action_t> &expected, const action_list_t &actions) {
+    if (expected.size() != actions.size()) return false;
+    for (std::size_t i = 0; i < actions.size(); i++) {
+        const auto &a1 = expected[i], &a2 = actions[i];
+        if (a1.begin != a2.begin || a1.end != a2.end) return false;
+    }
+    return true;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+class reporter {
+private:
+    const bool _csv;
+public:
+    explicit reporter(bool csv) : _csv(csv) {
+        if (_csv) std::cout << "benchmark,position,metric,value" << std::endl;
+    }
+
+    void report(const std::string &benchmark, const std::string &position, const std::string &metric, double value) {
+        if (_csv) {
+            std::cout << benchmark << "," << position << "," << metric << "," << std::fixed << std::setprecision(3)
+                      << value << std::endl;
+        } else {
+            std::cout << std::left << std::setw(26) << benchmark << std::setw(12) << position
+                      << std::setw(14) << metric << std::fixed << std::setprecision(3) << value << std::endl;
+        }
+    }
+};
+
+// counts leaves, and fails if any count differs from the reference
+static bool bench_perft(reporter &out, int depth) {
+    bool ok = true;
+    for (const auto &position : positions) {
+        const board_t board = to_board(position);
+        for (int d = 1; d <= depth; d++) {
+            auto start = std::chrono::steady_clock::now();
+            std::uint64_t leaves = perft(position.player, board, d);
+            double elapsed = seconds_since(start);
+            bool match = leaves == position.perft[d - 1];
+            ok = ok && match;
+            std::string name = "perft-" + std::to_string(d);
+            out.report(name, position.name, "leaves", (double) leaves);
+            out.report(name, position.name, "nodes/s", leaves / elapsed);
+            out.report(name, position.name, "match", match);
+        }
+    }
+    return ok;
+}
+
+// the table driven generator must keep the order of the reference one
+static bool bench_generators(reporter &out, int iterations) {
+    bool ok = true;
+    for (const auto &position : positions) {
+        const board_t board = to_board(position);
+        auto expected = get_legal_action(position.player, board);
+        action_list_t actions;
+        generate_actions(position.player, board, actions);
+        bool match = same_actions(expected, actions);
+        ok = ok && match;
+
+        std::size_t total = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) total += get_legal_action(position.player, board).size();
+        double reference_elapsed = seconds_since(start);
+
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            generate_actions(position.player, board, actions);
+            total += actions.size();
+        }
+        double table_elapsed = seconds_since(start);
+
+        out.report("get_legal_action", position.name, "calls/s", iterations / reference_elapsed);
+        out.report("generate_actions", position.name, "calls/s", iterations / table_elapsed);
+        out.report("generate_actions", position.name, "match", match);
+        sink = sink + total;
+    }
+    return ok;
+}
+
+// evaluates every child of every position, so the score update is part of the cost
+static void bench_evaluate(reporter &out, int iterations) {
+    for (const auto &position : positions) {
+        const board_t board = to_board(position);
+        action_list_t actions;
+        generate_actions(position.player, board, actions);
+
+        long long sum = 0;
+        std::uint64_t nodes = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            for (const auto &action : actions) {
+                board_t next = board;
+                apply_action(next, action);
+                sum += evaluate_chess(position.player, next);
+            }
+            nodes += actions.size();
+        }
+        double elapsed = seconds_since(start);
+        out.report("evaluate_chess", position.name, "nodes/s", nodes / elapsed);
+        sink = sink + sum;
+    }
+}
+
+// every supported kernel must give board.score for the board and every child, as the running score does
+static bool bench_eval_kernels(reporter &out, int iterations) {
+    bool ok = true;
+    for (const auto &position : positions) {
+        const board_t board = to_board(position);
+        action_list_t actions;
+        generate_actions(position.player, board, actions);
+        int expected[MAX_LEGAL_ACTIONS], values[MAX_LEGAL_ACTIONS];
+        board_t children[MAX_LEGAL_ACTIONS];
+        for (std::size_t i = 0; i < actions.size(); i++) {
+            children[i] = board;
+            apply_action(children[i], actions[i]);
+            expected[i] = evaluate_chess(position.player, children[i]);
+        }
+
+        for (auto kernel : {eval_kernel_t::scalar, eval_kernel_t::avx2}) {
+            if (!eval_kernel_supported(kernel)) continue;
+            const std::string name = eval_kernel_name(kernel);
+            bool match = evaluate_board(kernel, board) == board.score;
+            for (std::size_t i = 0; i < actions.size(); i++) {
+                match = match && evaluate_board(kernel, children[i]) == children[i].score;
+            }
+            evaluate_children(kernel, position.player, board, actions.begin(), actions.end(), values);
+            match = match && std::equal(expected, expected + actions.size(), values);
+            ok = ok && match;
+
+            long long sum = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; i++) {
+                for (std::size_t j = 0; j < actions.size(); j++) sum += evaluate_board(kernel, children[j]);
+            }
+            double board_elapsed = seconds_since(start);
+
+            start = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; i++) {
+                evaluate_children(kernel, position.player, board, actions.begin(), actions.end(), values);
+                sum += values[i % actions.size()];
+            }
+            double children_elapsed = seconds_since(start);
+
+            const double nodes = (double) iterations * actions.size();
+            out.report("evaluate_board-" + name, position.name, "nodes/s", nodes / board_elapsed);
+            out.report("evaluate_children-" + name, position.name, "nodes/s", nodes / children_elapsed);
+            out.report("evaluate_children-" + name, position.name, "match", match);
+            sink = sink + sum;
+        }
+    }
+    return ok;
+}
+
+// both searches must agree on the value, parallel search is meant to be only faster
+static bool bench_search(reporter &out, int depth, int actions_cnt) {
+    bool ok = true;
+    for (const auto &position : positions) {
+        const board_t board = to_board(position);
+        MinMaxAgent agent(position.player);
+        agent.max_search_depth = depth;
+        agent.max_search_depth_without_opponent = depth;
+        agent.max_search_actions_cnt = actions_cnt;
+        agent.enable_without_opponent = false;
+
+        agent.clear_tt();
+        auto start = std::chrono::steady_clock::now();
+        auto[normal_val, normal_action] = agent.run_normal(board);
+        double normal_elapsed = seconds_since(start);
+        const search_stats_t normal_stats = agent.search_stats();
+
+        agent.clear_tt();
+        start = std::chrono::steady_clock::now();
+        auto[parallel_val, parallel_action] = agent.run_parallel(board);
+        double parallel_elapsed = seconds_since(start);
+        const search_stats_t parallel_stats = agent.search_stats();
+
+        bool match = normal_val == parallel_val;
+        ok = ok && match;
+        out.report("run_normal", position.name, "ms", normal_elapsed * 1000);
+        out.report("run_normal", position.name, "nodes", normal_stats.nodes + normal_stats.leaves);
+        out.report("run_normal", position.name, "nodes/s", (normal_stats.nodes + normal_stats.leaves) / normal_elapsed);
+        out.report("run_normal", position.name, "ebf", normal_stats.effective_branching_factor);
+        out.report("run_normal", position.name, "first-cutoff", normal_stats.first_move_cutoff_rate);
+        out.report("run_normal", position.name, "value", normal_val);
+        out.report("run_parallel", position.name, "ms", parallel_elapsed * 1000);
+        out.report("run_parallel", position.name, "nodes/s",
+                   (parallel_stats.nodes + parallel_stats.leaves) / parallel_elapsed);
+        out.report("run_parallel", position.name, "match", match);
+    }
+    return ok;
+}
+
+// the iterative deepening of run_timed with plain alpha-beta, with pvs, and with pvs and the aspiration window.
+// all must agree on the value, pvs and the window are meant to be only faster.
+static bool bench_pvs(reporter &out, int depth, int actions_cnt) {
+    bool ok = true;
+    for (const auto &position : positions) {
+        const board_t board = to_board(position);
+        // a new agent each, the history of an earlier search would order the moves better
+        auto search = [&](bool pvs, bool aspiration, std::uint64_t &nodes) {
+            MinMaxAgent agent(position.player);
+            agent.max_search_actions_cnt = actions_cnt;
+            agent.enable_without_opponent = false;
+            agent.enable_pvs = pvs;
+            if (!aspiration) agent.aspiration_window = 0;
+            auto[val, action] = agent.run_deepening(board, depth);
+            nodes = agent.search_stats().nodes + agent.search_stats().leaves;
+            return val;
+        };
+        std::uint64_t plain_nodes, pvs_nodes, aspiration_nodes;
+        const int plain_val = search(false, false, plain_nodes);
+        const int pvs_val = search(true, false, pvs_nodes);
+        const int aspiration_val = search(true, true, aspiration_nodes);
+
+        bool match = plain_val == pvs_val && plain_val == aspiration_val;
+        ok = ok && match;
+        out.report("alpha_beta", position.name, "nodes", plain_nodes);
+        out.report("pvs", position.name, "nodes", pvs_nodes);
+        out.report("pvs", position.name, "saving", 1 - (double) pvs_nodes / plain_nodes);
+        out.report("pvs_aspiration", position.name, "nodes", aspiration_nodes);
+        out.report("pvs_aspiration", position.name, "saving", 1 - (double) aspiration_nodes / plain_nodes);
+        out.report("pvs_aspiration", position.name, "match", match);
+    }
+    return ok;
+}
+
+// the hard cut of max_search_actions_cnt against the selective search over all actions, both compared with
+// the full width search: nodes spent, and how often each picks an action the full width search would not
+static void bench_selective(reporter &out, int depth, int actions_cnt) {
+    for (const auto &position : positions) {
+        const board_t board = to_board(position);
+        auto search = [&](std::size_t cnt, bool selective, search_stats_t &stats, double &elapsed) {
+            MinMaxAgent agent(position.player);
+            agent.max_search_depth = depth;
+            agent.max_search_depth_without_opponent = depth;
+            agent.max_search_actions_cnt = cnt;
+            agent.enable_without_opponent = false;
+            agent.enable_lmr = selective;
+            agent.enable_futility = selective;
+            agent.enable_probcut = selective;
+            agent.set_seed(1);
+            auto start = std::chrono::steady_clock::now();
+            auto[val, action] = agent.run_normal(board);
+            elapsed = seconds_since(start);
+            stats = agent.search_stats();
+            return std::make_tuple(val, action);
+        };
+        search_stats_t full_stats, cut_stats, selective_stats;
+        double full_elapsed, cut_elapsed, selective_elapsed;
+        auto[full_val, full_action] = search(MAX_LEGAL_ACTIONS, false, full_stats, full_elapsed);
+        auto[cut_val, cut_action] = search(actions_cnt, false, cut_stats, cut_elapsed);
+        auto[selective_val, selective_action] = search(MAX_LEGAL_ACTIONS, true, selective_stats, selective_elapsed);
+
+        // the full width value of an action, the loss of an action is how much worse it is than the one
+        // the full width search picked
+        auto full_value_of = [&](const action_t &action) {
+            board_t next = board;
+            apply_action(next, action);
+            MinMaxAgent agent(3 - position.player);
+            agent.max_search_depth = std::max(depth - 1, 0);
+            agent.enable_without_opponent = false;
+            return is_finish(position.player, next) ? value_max : -std::get<0>(agent.run_normal(next)) - 1;
+        };
+        const int full_action_val = full_value_of(full_action);
+        out.report("full_width", position.name, "ms", full_elapsed * 1000);
+        out.report("full_width", position.name, "nodes", full_stats.nodes + full_stats.leaves);
+        out.report("full_width", position.name, "value", full_val);
+        out.report("hard_cut", position.name, "ms", cut_elapsed * 1000);
+        out.report("hard_cut", position.name, "nodes", cut_stats.nodes + cut_stats.leaves);
+        out.report("hard_cut", position.name, "value", cut_val);
+        out.report("hard_cut", position.name, "loss", full_action_val - full_value_of(cut_action));
+        out.report("selective", position.name, "ms", selective_elapsed * 1000);
+        out.report("selective", position.name, "nodes", selective_stats.nodes + selective_stats.leaves);
+        out.report("selective", position.name, "value", selective_val);
+        out.report("selective", position.name, "loss", full_action_val - full_value_of(selective_action));
+        out.report("selective", position.name, "reductions", selective_stats.reductions);
+        out.report("selective", position.name, "futility", selective_stats.futility_prunes);
+        out.report("selective", position.name, "probcut", selective_stats.probcut_cutoffs);
+    }
+}
+
+// a few moves of agents pondering on pools their helpers can not get a worker of: a dynamic pool of one worker,
+// and the shared pool with more pondering agents than workers. exits if a search does not come back in time,
+// the process can not end normally with a search stuck on the pool.
+static void bench_ponder(reporter &out) {
+    const board_t board = to_board(positions[2]);
+    const int player = positions[2].player;
+    auto play = [&](std::vector<std::unique_ptr<MinMaxAgent>> &agents) {
+        for (int move = 0; move < 3; move++) {
+            // every other move the agent that started pondering last searches first, while the others still ponder
+            for (std::size_t i = 0; i < agents.size(); i++) {
+                auto &agent = agents[move % 2 ? agents.size() - 1 - i : i];
+                auto[val, action] = agent->run_timed(board, std::chrono::milliseconds(20));
+                board_t next = board;
+                apply_action(next, action);
+                agent->start_ponder(next);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        for (auto &agent : agents) agent->stop_ponder();
+    };
+    auto make_agent = [&](search_mode_t mode) {
+        auto agent = std::make_unique<MinMaxAgent>(player);
+        agent->search_mode = mode;
+        agent->lazy_smp_helpers_cnt = 2;
+        return agent;
+    };
+
+    const std::pair<const char *, search_mode_t> modes[] = {{"ybwc",     search_mode_t::ybwc},
+                                                            {"lazy-smp", search_mode_t::lazy_smp}};
+    for (const auto &mode : modes) {
+        const std::pair<const char *, std::function<void()>> cases[] = {
+                {"one-worker",  [&] {
+                    std::vector<std::unique_ptr<MinMaxAgent>> agents;
+                    agents.emplace_back(make_agent(mode.second));
+                    agents.back()->use_dynamic_pool(1, 1, std::chrono::milliseconds(1000));
+                    play(agents);
+                }},
+                {"shared-full", [&] {
+                    std::vector<std::unique_ptr<MinMaxAgent>> agents;
+                    for (std::size_t i = 0; i <= search_pool_size(); i++) agents.emplace_back(make_agent(mode.second));
+                    play(agents);
+                }},
+        };
+        for (const auto &c : cases) {
+            // a deadlocked search never returns, so it runs on a thread that is left behind on failure
+            auto done = std::make_shared<std::promise<void>>();
+            auto finished = done->get_future();
+            std::thread([done, run = c.second] {
+                run();
+                done->set_value();
+            }).detach();
+            const auto start = std::chrono::steady_clock::now();
+            const bool returned = finished.wait_for(std::chrono::seconds(30)) == std::future_status::ready;
+            out.report(std::string("ponder_") + mode.first, c.first, "ms", seconds_since(start) * 1000);
+            out.report(std::string("ponder_") + mode.first, c.first, "returned", returned);
+            if (!returned) {
+                std::cerr << "[ERROR]: a pondering agent did not return from its search" << std::endl;
+                std::_Exit(1);
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    bool csv = false;
+    // pvs only probes nodes with min_pvs_depth (4) plies left, so its comparison needs a deeper search
+    int perft_depth = 3, search_depth = 3, pvs_depth = 5, search_actions_cnt = 32, iterations = 20000;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp("--csv", argv[i]) == 0) {
+            csv = true;
+        } else if (strcmp("--perft-depth", argv[i]) == 0 && i + 1 < argc) {
+            perft_depth = std::min(std::max(std::atoi(argv[++i]), 1), MAX_PERFT_DEPTH);
+        } else if (strcmp("--search-depth", argv[i]) == 0 && i + 1 < argc) {
+            search_depth = std::max(std::atoi(argv[++i]), 0);
+        } else if (strcmp("--pvs-depth", argv[i]) == 0 && i + 1 < argc) {
+            pvs_depth = std::max(std::atoi(argv[++i]), 0);
+        } else if (strcmp("--search-actions", argv[i]) == 0 && i + 1 < argc) {
+            search_actions_cnt = std::max(std::atoi(argv[++i]), 1);
+        } else if (strcmp("--iterations", argv[i]) == 0 && i + 1 < argc) {
+            iterations = std::max(std::atoi(argv[++i]), 1);
+        } else {
+            std::cout << "usage: " << argv[0] << " [--csv] [--perft-depth 1-" << MAX_PERFT_DEPTH << ", default=3]"
+                      << " [--search-depth n, default=3] [--pvs-depth n, default=5] [--search-actions n, default=32]"
+                      << " [--iterations n, default=20000]" << std::endl;
+            return -1;
+        }
+    }
+
+    reporter out(csv);
+    bool ok = bench_perft(out, perft_depth);
+    ok = bench_generators(out, iterations) && ok;
+    bench_evaluate(out, iterations);
+    ok = bench_eval_kernels(out, iterations) && ok;
+    ok = bench_search(out, search_depth, search_actions_cnt) && ok;
+    ok = bench_pvs(out, pvs_depth, search_actions_cnt) && ok;
+    bench_selective(out, search_depth + 1, search_actions_cnt);
+    bench_ponder(out);
+
+    if (!ok) std::cerr << "[ERROR]: results differ from the reference" << std::endl;
+    return ok ? 0 : 1;
+}
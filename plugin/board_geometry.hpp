@@ -0,0 +1,47 @@
+#ifndef PLUGIN_BOARD_GEOMETRY_HPP
+#define PLUGIN_BOARD_GEOMETRY_HPP
+
+// the board of the build, Board(size, piece_rows) of board.py.
+// cmake -DBOARD_SIZE=n -DPIECE_ROWS=n builds another one, every table of the engine follows at compile time.
+#ifndef PLUGIN_BOARD_SIZE
+#define PLUGIN_BOARD_SIZE 10
+#endif
+#ifndef PLUGIN_PIECE_ROWS
+#define PLUGIN_PIECE_ROWS 4
+#endif
+
+// Size * Size cells, cell (x, y) sits on row x + y + 1 of the python board.
+// player 1 moves to the triangle x + y < PieceRows at the (0, 0) corner, player 2 to the mirrored one,
+// and each starts on the target of the other. three pieces of each player are special, they start and
+// finish on the three cells next to the corners.
+template<int Size, int PieceRows>
+struct board_geometry {
+    static_assert(PieceRows >= 3 && PieceRows < Size, "piece rows must hold the special cells and leave a gap");
+    static_assert(Size * Size <= 128, "cells must fit in mask_t");
+
+    static constexpr int SIZE = Size;
+    static constexpr int PIECE_ROWS = PieceRows;
+    static constexpr int CELL_CNT = Size * Size;
+    static constexpr int PIECE_CNT = PieceRows * (PieceRows + 1) / 2;
+    static constexpr int SPECIAL_CNT = 3;
+
+    static constexpr bool is_target(int player, int x, int y) {
+        return player == 1 ? x + y < PieceRows : is_target(1, Size - 1 - x, Size - 1 - y);
+    }
+
+    static constexpr bool is_special_target(int player, int x, int y) {
+        if (player != 1) return is_special_target(1, Size - 1 - x, Size - 1 - y);
+        return (x == 0 && y == 1) || (x == 1 && y == 0) || (x == 1 && y == 1);
+    }
+
+    // chess value of the cell in the start position
+    static constexpr int start_value(int x, int y) {
+        if (is_target(2, x, y)) return is_special_target(2, x, y) ? 3 : 1;
+        if (is_target(1, x, y)) return is_special_target(1, x, y) ? 4 : 2;
+        return 0;
+    }
+};
+
+using geometry = board_geometry<PLUGIN_BOARD_SIZE, PLUGIN_PIECE_ROWS>;
+
+#endif //PLUGIN_BOARD_GEOMETRY_HPP
@@ -0,0 +1,159 @@
+#include "chess.hpp"
+#include "game_rules.hpp"
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <cstdlib>
+#include <memory>
+#include <numeric>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+struct book_config_t {
+    int plies{6};   // positions with fewer actions played than this get a book action
+    int width{3};   // besides the best action, the children of the best actions by evaluation are expanded
+    int depth{6};
+    int wo_depth{5};
+    int actions{36};
+    int tt_mb{64};
+    int threads{static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u))};
+};
+
+struct book_position_t {
+    int player;
+    board_t board;
+};
+
+// the searched action of one position, and the positions it leads to in the next ply
+struct book_result_t {
+    std::uint64_t key;
+    book_move_t move;
+    std::vector<book_position_t> children;
+};
+
+static book_result_t search_position(MinMaxAgent &agent, const book_position_t &position, int width) {
+    auto[val, best] = agent.run(position.board);
+    book_result_t result;
+    result.key = opening_book::key_of(position.player, position.board);
+    result.move = {(std::uint8_t) to_cell(best.begin), (std::uint8_t) to_cell(best.end),
+                   (std::int16_t) std::min(std::max(val, -32768), 32767)};
+
+    // the best action, then those the opponent is likely to meet, by the evaluation after them
+    action_list_t actions;
+    generate_actions(position.player, position.board, actions);
+    std::vector<int> values(actions.size());
+    evaluate_children(position.player, position.board, actions.begin(), actions.end(), values.data());
+    std::vector<std::size_t> order(actions.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return values[a] > values[b]; });
+    board_t child = position.board;
+    apply_action(child, best);
+    result.children.push_back({3 - position.player, child});
+    for (std::size_t i = 0; i < order.size() && (int) result.children.size() <= width; i++) {
+        const action_t &action = actions[order[i]];
+        if (action.begin == best.begin && action.end == best.end) continue;
+        child = position.board;
+        apply_action(child, action);
+        result.children.push_back({3 - position.player, child});
+    }
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    book_config_t config;
+    std::string path = "opening.book";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp("--plies", argv[i]) == 0 && i + 1 < argc) {
+            config.plies = std::max(std::atoi(argv[++i]), 1);
+        } else if (strcmp("--width", argv[i]) == 0 && i + 1 < argc) {
+            config.width = std::max(std::atoi(argv[++i]), 0);
+        } else if (strcmp("--depth", argv[i]) == 0 && i + 1 < argc) {
+            config.depth = std::max(std::atoi(argv[++i]), 0);
+        } else if (strcmp("--wo-depth", argv[i]) == 0 && i + 1 < argc) {
+            config.wo_depth = std::max(std::atoi(argv[++i]), 0);
+        } else if (strcmp("--actions", argv[i]) == 0 && i + 1 < argc) {
+            config.actions = std::max(std::atoi(argv[++i]), 1);
+        } else if (strcmp("--tt", argv[i]) == 0 && i + 1 < argc) {
+            config.tt_mb = std::max(std::atoi(argv[++i]), 0);
+        } else if (strcmp("--threads", argv[i]) == 0 && i + 1 < argc) {
+            config.threads = std::max(std::atoi(argv[++i]), 1);
+        } else if (strcmp("--out", argv[i]) == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else {
+            std::cout << "usage: " << argv[0] << " [--plies n, default=6] [--width n, default=3]"
+                      << " [--depth n, default=6] [--wo-depth n, default=5] [--actions n, default=36]"
+                      << " [--tt mb, default=64] [--threads n, default=cores] [--out path, default=opening.book]"
+                      << std::endl;
+            return -1;
+        }
+    }
+
+    int chess[BOARD_SIZE][BOARD_SIZE];
+    std::memcpy(chess, start_chess.value, sizeof(chess));
+    std::vector<book_position_t> level = {{1, to_board(chess)}};
+    std::unordered_set<std::uint64_t> seen = {opening_book::key_of(1, level.front().board)};
+    std::vector<std::uint64_t> keys;
+    std::vector<book_move_t> moves;
+
+    for (int ply = 0; ply < config.plies && !level.empty(); ply++) {
+        // positions of a ply are searched side by side, each search also splits on the search pool
+        std::vector<book_result_t> results(level.size());
+        std::atomic<std::size_t> next{0};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < std::min<int>(config.threads, level.size()); t++) {
+            threads.emplace_back([&]() {
+                std::unique_ptr<MinMaxAgent> agents[2] = {std::make_unique<MinMaxAgent>(1),
+                                                          std::make_unique<MinMaxAgent>(2)};
+                for (auto &agent : agents) {
+                    agent->max_search_depth = config.depth;
+                    agent->max_search_depth_without_opponent = config.wo_depth;
+                    agent->max_search_actions_cnt = config.actions;
+                    agent->enable_without_opponent = true;
+                    agent->enable_opening_book = false;
+                    agent->search_mode = search_mode_t::ybwc;
+                    agent->set_tt_size(config.tt_mb);
+                    // the same book every time
+                    agent->set_seed(1);
+                }
+                for (std::size_t i; (i = next++) < level.size();) {
+                    results[i] = search_position(*agents[level[i].player - 1], level[i], config.width);
+                }
+            });
+        }
+        for (auto &thread : threads) thread.join();
+
+        std::vector<book_position_t> next_level;
+        for (auto &result : results) {
+            keys.push_back(result.key);
+            moves.push_back(result.move);
+            for (auto &child : result.children) {
+                // nothing to look up once a game is over
+                if (is_finish(3 - child.player, child.board)) continue;
+                if (seen.insert(opening_book::key_of(child.player, child.board)).second) next_level.push_back(child);
+            }
+        }
+        std::cout << "ply " << ply << ": " << level.size() << " positions" << std::endl;
+        level.swap(next_level);
+    }
+
+    std::vector<std::size_t> order(keys.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return keys[a] < keys[b]; });
+    std::vector<std::uint64_t> sorted_keys;
+    std::vector<book_move_t> sorted_moves;
+    for (std::size_t i : order) {
+        // a key collision of two positions keeps the first, the probe checks the action is legal anyway
+        if (!sorted_keys.empty() && sorted_keys.back() == keys[i]) continue;
+        sorted_keys.push_back(keys[i]);
+        sorted_moves.push_back(moves[i]);
+    }
+    std::cout << "book of " << sorted_keys.size() << " positions" << std::endl;
+
+    if (!opening_book::write(path, sorted_keys, sorted_moves, config.depth)) {
+        std::cerr << "[ERROR]: can not write " << path << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -1,9 +1,15 @@
 #include "chess.hpp"
-#include "thread_pools.hpp"
+#include "work_stealing_pool.hpp"
+#include "evaluation.hpp"
 #include <algorithm>
 #include <random>
 #include <chrono>
 #include <cstring>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <cmath>
 
 static constexpr point_t steps[6] = {{0,  1},
                                      {0,  -1},
@@ -21,125 +27,162 @@ static constexpr point_t directions[] = {
         {-1, 1}
 };
 
-static constexpr int score7[10][10] = {
-        {400, 0,   317, 280, 245, 213, 184, 157, 132, 110},
-        {0,   0,   286, 250, 218, 188, 160, 135, 112, 92},
-        {317, 286, 256, 222, 192, 163, 138, 114, 94,  75},
-        {280, 250, 222, 196, 167, 141, 117, 96,  76,  60},
-        {245, 218, 192, 167, 144, 119, 98,  78,  61,  46},
-        {213, 188, 163, 141, 119, 100, 80,  62,  47,  34},
-        {184, 160, 138, 117, 98,  80,  64,  48,  35,  24},
-        {157, 135, 114, 96,  78,  62,  48,  36,  24,  15},
-        {132, 112, 94,  76,  61,  47,  35,  24,  16,  8},
-        {110, 92,  75,  60,  46,  34,  24,  15,  8,   4},
+static inline constexpr bool is_out_of_range(const point_t &p) {
+    return p.x < 0 || p.x >= BOARD_SIZE || p.y < 0 || p.y >= BOARD_SIZE;
+}
+
+// cell offset of each direction, in the order of directions
+static constexpr int direction_offsets[6] = {1, -1, BOARD_SIZE, -BOARD_SIZE, BOARD_SIZE - 1, 1 - BOARD_SIZE};
+
+// with k empty cells before the bridge, a jump lands 2k+2 cells away, which must stay on the board
+static constexpr int MAX_BRIDGE_DIST = (BOARD_SIZE - 1) / 2;
+
+struct ray_table_t {
+    int step[CELL_CNT][6];                               // neighbor cell, -1 if out of range
+    mask_t ray[CELL_CNT][6];                             // cells from next to the cell to the border
+    mask_t jump_path[CELL_CNT][6][MAX_BRIDGE_DIST];      // cells after the bridge, landing cell included
+    int jump_land[CELL_CNT][6][MAX_BRIDGE_DIST];         // landing cell, -1 if out of range
 };
 
-static constexpr int score3[10][10] = {
-        {0,   357, 100, 280, 245, 213, 184, 157, 132, 110},
-        {357, 324, 286, 250, 218, 188, 160, 135, 112, 92},
-        {100, 286, 256, 222, 192, 163, 138, 114, 94,  75},
-        {280, 250, 222, 196, 167, 141, 117, 96,  76,  60},
-        {245, 218, 192, 167, 144, 119, 98,  78,  61,  46},
-        {213, 188, 163, 141, 119, 100, 80,  62,  47,  34},
-        {184, 160, 138, 117, 98,  80,  64,  48,  35,  24},
-        {157, 135, 114, 96,  78,  62,  48,  36,  24,  15},
-        {132, 112, 94,  76,  61,  47,  35,  24,  16,  8},
-        {110, 92,  75,  60,  46,  34,  24,  15,  8,   4},
+static constexpr ray_table_t make_ray_table() {
+    ray_table_t table{};
+    for (int cell = 0; cell < CELL_CNT; cell++) {
+        for (int d = 0; d < 6; d++) {
+            const point_t begin = to_point(cell);
+            const point_t step = begin + directions[d];
+            table.step[cell][d] = is_out_of_range(step) ? -1 : to_cell(step);
+
+            int ray[BOARD_SIZE]{}, ray_len = 0;
+            for (point_t p = step; !is_out_of_range(p); p += directions[d]) {
+                ray[ray_len++] = to_cell(p);
+                table.ray[cell][d] |= cell_mask(to_cell(p));
+            }
+            for (int k = 0; k < MAX_BRIDGE_DIST; k++) {
+                table.jump_land[cell][d][k] = -1;
+                if (2 * k + 1 >= ray_len) continue;
+                for (int i = k + 1; i <= 2 * k + 1; i++) {
+                    table.jump_path[cell][d][k] |= cell_mask(ray[i]);
+                }
+                table.jump_land[cell][d][k] = ray[2 * k + 1];
+            }
+        }
+    }
+    return table;
+}
+
+static constexpr ray_table_t rays = make_ray_table();
+
+static constexpr std::uint64_t splitmix64(std::uint64_t &state) {
+    std::uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+struct zobrist_table_t {
+    std::uint64_t piece[4][CELL_CNT]; // indexed by chess value - 1
+    std::uint64_t player2;            // player 2 to move
+    std::uint64_t without_opponent;   // searched without opponent
 };
 
-static thread_pool::static_pool pool;
+// fixed seed, so hashes stay the same between runs
+static constexpr zobrist_table_t make_zobrist_table() {
+    zobrist_table_t table{};
+    std::uint64_t state = 0x20200922;
+    for (auto &keys : table.piece) {
+        for (auto &key : keys) key = splitmix64(state);
+    }
+    table.player2 = splitmix64(state);
+    table.without_opponent = splitmix64(state);
+    return table;
+}
 
-static std::default_random_engine e(std::chrono::system_clock::now().time_since_epoch().count());
+static constexpr zobrist_table_t zobrist = make_zobrist_table();
+
+static inline std::uint64_t search_key(const board_t &board, int current_player, int without_opponent) {
+    return board.hash ^ (current_player == 2 ? zobrist.player2 : 0) ^
+           (without_opponent ? zobrist.without_opponent : 0);
+}
+
+// joining the workers waits for running tasks. the pool is built by the first agent, so it is destroyed
+// after every agent, and no agent has a ponder or helper search left running by then.
+static thread_pool::work_stealing_pool &search_pool() {
+    static thread_pool::work_stealing_pool pool;
+    return pool;
+}
 
 class auto_action_applier {
 private:
-    chess_t _chess;
-    const point_t &_begin;
-    const point_t &_end;
+    board_t &_board;
+    const mask_t _move;
+    const int _owner;
+    const bool _special;
+    const std::uint64_t _hash;
+    const int _score;
 public:
-    auto_action_applier(chess_t chess, const point_t &begin, const point_t &end)
-            : _chess(chess), _begin(begin), _end(end) {
+    auto_action_applier(board_t &board, const point_t &begin, const point_t &end)
+            : _board(board), _move(cell_mask(to_cell(begin)) | cell_mask(to_cell(end))),
+              _owner((board.pieces[0] & cell_mask(to_cell(begin))) ? 0 : 1),
+              _special(board.special & cell_mask(to_cell(begin))),
+              _hash(zobrist.piece[_owner + (_special ? 2 : 0)][to_cell(begin)] ^
+                    zobrist.piece[_owner + (_special ? 2 : 0)][to_cell(end)]),
+              _score(piece_square.value[_owner + (_special ? 2 : 0)][to_cell(end)] -
+                     piece_square.value[_owner + (_special ? 2 : 0)][to_cell(begin)]) {
         // apply action
-        _chess[_end.x][_end.y] = _chess[_begin.x][_begin.y];
-        _chess[_begin.x][_begin.y] = 0;
+        _board.pieces[_owner] ^= _move;
+        if (_special) _board.special ^= _move;
+        _board.hash ^= _hash;
+        _board.score += _score;
     }
 
     ~auto_action_applier() {
         // resume action
-        _chess[_begin.x][_begin.y] = _chess[_end.x][_end.y];
-        _chess[_end.x][_end.y] = 0;
+        _board.pieces[_owner] ^= _move;
+        if (_special) _board.special ^= _move;
+        _board.hash ^= _hash;
+        _board.score -= _score;
     }
 };
 
-static void get_curr_idx(int player, chess_ct chess, std::array<point_t, 10> &curr_idx) {
-    int curr_idx_cnt = 0;
-    for (int x = 0; x < 10; x++) {
-        for (int y = 0; y < 10; y++) {
-            if (chess[x][y] == player || chess[x][y] == player + 2) {
-                curr_idx[curr_idx_cnt++] = {x, y};
-            }
-        }
-    }
+void apply_action(board_t &board, const action_t &action) {
+    const int begin = to_cell(action.begin), end = to_cell(action.end);
+    const int owner = (board.pieces[0] & cell_mask(begin)) ? 0 : 1;
+    const int value = owner + ((board.special & cell_mask(begin)) ? 2 : 0);
+    const mask_t move = cell_mask(begin) | cell_mask(end);
+    board.pieces[owner] ^= move;
+    if (value >= 2) board.special ^= move;
+    board.hash ^= zobrist.piece[value][begin] ^ zobrist.piece[value][end];
+    board.score += piece_square.value[value][end] - piece_square.value[value][begin];
 }
 
-static inline bool is_out_of_range(const point_t &p) {
-    return p.x < 0 || p.x >= 10 || p.y < 0 || p.y >= 10;
+board_t to_board(chess_ct chess) {
+    board_t board;
+    for (int cell = 0; cell < CELL_CNT; cell++) {
+        auto[x, y] = to_point(cell);
+        int value = chess[x][y];
+        if (value == 0) continue;
+        // 1, 3 belong to player 1 and 2, 4 belong to player 2
+        board.pieces[(value - 1) % 2] |= cell_mask(cell);
+        if (value > 2) board.special |= cell_mask(cell);
+        board.hash ^= zobrist.piece[value - 1][cell];
+        board.score += piece_square.value[value - 1][cell];
+    }
+    return board;
 }
 
-static inline bool is_empty_position(chess_ct chess, const point_t &p) {
-    return chess[p.x][p.y] == 0;
+void to_chess(const board_t &board, chess_t chess) {
+    for (int cell = 0; cell < CELL_CNT; cell++) {
+        auto[x, y] = to_point(cell);
+        int owner = 0;
+        if (board.pieces[0] & cell_mask(cell)) owner = 1;
+        else if (board.pieces[1] & cell_mask(cell)) owner = 2;
+        if (owner != 0 && (board.special & cell_mask(cell))) owner += 2;
+        chess[x][y] = owner;
+    }
 }
 
-static bool is_legal_jump(chess_ct chess, const point_t &curr, const point_t &jump, const point_t &end) {
-    bool legal = true;
-    if (jump.x == 0 && jump.y != 0) {
-        int bias = jump.y > 0 ? 1 : -1;
-        for (int y = curr.y + bias; y != end.y; y += bias) {
-            if (y == (curr.y + end.y) / 2) {
-                if (chess[end.x][y] == 0) {
-                    legal = false;
-                    break;
-                }
-            } else {
-                if (chess[end.x][y] != 0) {
-                    legal = false;
-                    break;
-                }
-            }
-        }
-    } else if (jump.x != 0 && jump.y == 0) {
-        int bias = jump.x > 0 ? 1 : -1;
-        for (int x = curr.x + bias; x != end.x; x += bias) {
-            if (x == (curr.x + end.x) / 2) {
-                if (chess[x][end.y] == 0) {
-                    legal = false;
-                    break;
-                }
-            } else {
-                if (chess[x][end.y] != 0) {
-                    legal = false;
-                    break;
-                }
-            }
-        }
-    } else {
-        int bias_x = jump.x > 0 ? 1 : -1;
-        int bias_y = jump.y > 0 ? 1 : -1;
-        for (int x = curr.x + bias_x, y = curr.y + bias_y; x != end.x; x += bias_x, y += bias_y) {
-            if (x == (curr.x + end.x) / 2) {
-                if (chess[x][y] == 0) {
-                    legal = false;
-                    break;
-                }
-            } else {
-                if (chess[x][y] != 0) {
-                    legal = false;
-                    break;
-                }
-            }
-        }
-    }
-    return legal;
+static inline bool is_empty_position(mask_t occupied, const point_t &p) {
+    return !(occupied & cell_mask(to_cell(p)));
 }
 
 static bool is_same_action(const std::vector<action_t> &actions,
@@ -149,7 +192,9 @@ static bool is_same_action(const std::vector<action_t> &actions,
     });
 }
 
-void dfs_jumps(chess_t chess, const point_t &begin, const point_t &curr, std::vector<action_t> &actions) {
+// the jumping piece has left begin and never lies on its own rays,
+// so the occupancy stays the same along the whole jump chain.
+void dfs_jumps(mask_t occupied, const point_t &begin, const point_t &curr, std::vector<action_t> &actions) {
     // 遍历每个可以跳的方向
     for (const auto &direction : directions) {
         bool finding_bridge = true;
@@ -157,19 +202,18 @@ void dfs_jumps(chess_t chess, const point_t &begin, const point_t &curr, std::ve
         // 遍历这个方向上的棋盘
         for (point_t end = curr + direction; !is_out_of_range(end); end += direction) {
             if (finding_bridge) {
-                if (chess[end.x][end.y] == 0) {
+                if (is_empty_position(occupied, end)) {
                     before_bridge_len++;
                 } else {
                     finding_bridge = false;
                 }
             } else {
-                if (chess[end.x][end.y] == 0) {
+                if (is_empty_position(occupied, end)) {
                     if (after_bridge_len == before_bridge_len) {
                         if (begin != end && !is_same_action(actions, begin, end)) {
                             // 找到一个合法的跳法
                             actions.emplace_back(action_t{begin, end});
-                            auto_action_applier applier(chess, curr, end);
-                            dfs_jumps(chess, begin, end, actions);
+                            dfs_jumps(occupied, begin, end, actions);
                         }
                         break;
                     } else {
@@ -183,98 +227,205 @@ void dfs_jumps(chess_t chess, const point_t &begin, const point_t &curr, std::ve
     }
 }
 
-std::vector<action_t> get_legal_action(int player, chess_t chess) {
+std::vector<action_t> get_legal_action(int player, const board_t &board) {
     std::vector<action_t> actions;
     actions.reserve(200);
 
-    std::array<point_t, 10> curr_idx{};
-    get_curr_idx(player, chess, curr_idx);
+    const mask_t occupied = board.pieces[0] | board.pieces[1];
+    const mask_t own = board.pieces[player - 1];
 
-    for (auto begin : curr_idx) {
+    for (mask_t m = own; m; m &= m - 1) {
+        auto begin = to_point(mask_ctz(m));
         for (auto step : steps) {
             auto end = begin + step;
             if (is_out_of_range(end)) continue;
-            if (!is_empty_position(chess, end)) continue;
+            if (!is_empty_position(occupied, end)) continue;
             actions.emplace_back(action_t{begin, end});
         }
     }
 
-    for (auto begin : curr_idx) {
-        dfs_jumps(chess, begin, begin, actions);
+    for (mask_t m = own; m; m &= m - 1) {
+        int begin = mask_ctz(m);
+        dfs_jumps(occupied & ~cell_mask(begin), to_point(begin), to_point(begin), actions);
     }
 
     return actions;
 }
 
-bool is_finish(int player, chess_ct chess) {
-    if (player == 1) {
-        if (chess[0][0] == 1 && chess[0][1] == 3 && chess[0][2] == 1 && chess[0][3] == 1 &&
-            chess[1][0] == 3 && chess[1][1] == 3 && chess[1][2] == 1 &&
-            chess[2][0] == 1 && chess[2][1] == 1 &&
-            chess[3][0] == 1)
-            return true;
-    } else {
-        if (chess[9][9] == 2 && chess[9][8] == 4 && chess[9][7] == 2 && chess[9][6] == 2 &&
-            chess[8][9] == 4 && chess[8][8] == 4 && chess[8][7] == 2 &&
-            chess[7][9] == 2 && chess[7][8] == 2 &&
-            chess[6][9] == 2)
-            return true;
+// visited holds begin, its step targets and all landed cells, which is exactly
+// what is_same_action rejects in dfs_jumps.
+static void dfs_jumps_table(mask_t occupied, int begin, int curr, mask_t &visited, action_list_t &actions) {
+    for (int d = 0; d < 6; d++) {
+        const mask_t blockers = occupied & rays.ray[curr][d];
+        if (!blockers) continue;
+        // the nearest blocker is the bridge
+        const int bridge = direction_offsets[d] > 0 ? mask_ctz(blockers) : mask_msb(blockers);
+        const int k = (bridge - curr) / direction_offsets[d] - 1;
+        if (k >= MAX_BRIDGE_DIST) continue;
+        const int land = rays.jump_land[curr][d][k];
+        if (land < 0 || (occupied & rays.jump_path[curr][d][k])) continue;
+        if (visited & cell_mask(land)) continue;
+        visited |= cell_mask(land);
+        actions.push_back(action_t{to_point(begin), to_point(land)});
+        dfs_jumps_table(occupied, begin, land, visited, actions);
     }
-    return false;
 }
 
-static int evaluate_chess(int player, chess_ct chess) {
-    int value1 = 0, value2 = 0;
-
-    for (int i = 0; i < 100; i++) {
-        int x = i / 10;
-        int y = i % 10;
-        if (chess[x][y] == 1) {
-            value1 += score7[x][y];
-        } else if (chess[x][y] == 3) {
-            value1 += score3[x][y];
-        } else if (chess[x][y] == 2) {
-            value2 += score7[9 - x][9 - y];
-        } else if (chess[x][y] == 4) {
-            value2 += score3[9 - x][9 - y];
+void generate_actions(int player, const board_t &board, action_list_t &actions) {
+    const mask_t occupied = board.pieces[0] | board.pieces[1];
+    const mask_t own = board.pieces[player - 1];
+    actions.clear();
+
+    for (mask_t m = own; m; m &= m - 1) {
+        const int begin = mask_ctz(m);
+        for (int d = 0; d < 6; d++) {
+            const int end = rays.step[begin][d];
+            if (end < 0 || (occupied & cell_mask(end))) continue;
+            actions.push_back(action_t{to_point(begin), to_point(end)});
         }
     }
 
-    if (player == 1) {
-        return value1 - value2;
-    } else {
-        return value2 - value1;
-    }
-}
-
-static bool is_without_opponent(chess_ct chess) {
-    int p1_min = std::numeric_limits<int>::max();
-    int p1_max = std::numeric_limits<int>::min();
-    int p2_min = std::numeric_limits<int>::max();
-    int p2_max = std::numeric_limits<int>::min();
-    for (int x = 0; x < 10; x++) {
-        for (int y = 0; y < 10; y++) {
-            if (chess[x][y] == 1 || chess[x][y] == 3) {
-                p1_min = std::min(x + y, p1_min);
-                p1_max = std::max(x + y, p1_max);
-            } else if (chess[x][y] == 2 || chess[x][y] == 4) {
-                p2_min = std::min(x + y, p2_min);
-                p2_max = std::max(x + y, p2_max);
-            }
+    for (mask_t m = own; m; m &= m - 1) {
+        const int begin = mask_ctz(m);
+        mask_t visited = cell_mask(begin);
+        for (int d = 0; d < 6; d++) {
+            if (rays.step[begin][d] >= 0) visited |= cell_mask(rays.step[begin][d]);
+        }
+        visited &= ~occupied | cell_mask(begin);
+        dfs_jumps_table(occupied & ~cell_mask(begin), begin, begin, visited, actions);
+    }
+}
+
+bool is_finish(int player, const board_t &board) {
+    const mask_t target = finish_mask[player - 1];
+    return (board.pieces[player - 1] & target) == target &&
+           (board.special & target) == finish_special_mask[player - 1];
+}
+
+// the score is kept by auto_action_applier, so a leaf costs no board scan
+int evaluate_chess(int player, const board_t &board) {
+    return player == 1 ? board.score : -board.score;
+}
+
+// halves of the range are forked, so each task lives in a frame of the fork and nothing is allocated
+static void fork_search_range(std::size_t begin, std::size_t end, const std::function<void(std::size_t)> &task) {
+    if (end - begin == 1) {
+        task(begin);
+        return;
+    }
+    const std::size_t mid = begin + (end - begin) / 2;
+    search_pool().join([&]() { fork_search_range(begin, mid, task); },
+                       [&]() { fork_search_range(mid, end, task); });
+}
+
+void fork_search_tasks(std::size_t n, const std::function<void(std::size_t)> &task) {
+    if (n > 0) fork_search_range(0, n, task);
+}
+
+std::size_t search_pool_size() {
+    return search_pool().size;
+}
+
+template<typename Func, typename... Args>
+std::future<void> MinMaxAgent::enqueue_task(Func &&f, Args &&... args) {
+    pool_tasks->fetch_add(1, std::memory_order_relaxed);
+    auto task = [tasks = pool_tasks, call = std::bind(std::forward<Func>(f), std::forward<Args>(args)...)]() mutable {
+        call();
+        tasks->fetch_sub(1, std::memory_order_relaxed);
+    };
+    if (pool) return pool->enqueue(std::move(task));
+    return search_pool().enqueue(std::move(task));
+}
+
+std::size_t MinMaxAgent::pool_size() const {
+    return pool ? pool->max_size() : search_pool().size;
+}
+
+std::size_t MinMaxAgent::free_pool_tasks() const {
+    const std::size_t used = pool_tasks->load(std::memory_order_relaxed);
+    return used < max_pool_tasks ? max_pool_tasks - used : 0;
+}
+
+void MinMaxAgent::use_dynamic_pool(std::size_t max_workers, std::size_t idle_workers,
+                                   std::chrono::milliseconds idle_timeout) {
+    stop_ponder();
+    // the old pool finishes whatever split helpers are still queued on it
+    pool.reset();
+    if (max_workers == 0) return;
+    pool = std::make_unique<thread_pool::dynamic_pool>(max_workers, std::min(idle_workers, max_workers), idle_timeout);
+}
+
+thread_pool::dynamic_pool_stats MinMaxAgent::pool_stats() const {
+    return pool ? pool->stats() : thread_pool::dynamic_pool_stats{};
+}
+
+static endgame_db endgame;
+
+bool open_endgame_db(const std::string &path) {
+    return endgame.open(path);
+}
+
+bool probe_endgame_db(int player, const board_t &board, int &distance) {
+    return endgame.probe(player, board, distance);
+}
+
+static opening_book book;
+
+bool open_opening_book(const std::string &path) {
+    return book.open(path);
+}
+
+bool probe_opening_book(int player, const board_t &board, action_t &action, int &value) {
+    book_move_t move{};
+    if (!book.probe(player, board, move)) return false;
+    // another position with the same key would rarely have the action
+    action_list_t legal_actions;
+    generate_actions(player, board, legal_actions);
+    const auto it = std::find_if(legal_actions.begin(), legal_actions.end(), [&](const action_t &a) {
+        return to_cell(a.begin) == move.begin && to_cell(a.end) == move.end;
+    });
+    if (it == legal_actions.end()) return false;
+    action = *it;
+    value = move.value;
+    return true;
+}
+
+static bool is_without_opponent(const board_t &board) {
+    int p_min[2] = {std::numeric_limits<int>::max(), std::numeric_limits<int>::max()};
+    int p_max[2] = {std::numeric_limits<int>::min(), std::numeric_limits<int>::min()};
+    for (int i = 0; i < 2; i++) {
+        for (mask_t m = board.pieces[i]; m; m &= m - 1) {
+            auto[x, y] = to_point(mask_ctz(m));
+            p_min[i] = std::min(x + y, p_min[i]);
+            p_max[i] = std::max(x + y, p_max[i]);
         }
     }
-    return p1_min >= p2_max || p1_max < p2_min;
+    return p_min[0] >= p_max[1] || p_max[0] < p_min[1];
 }
 
-void sort_actions(int player, std::vector<action_t> &actions) {
+// the armies passed each other, no piece of player 1 is further from (0, 0) than any of player 2
+static bool is_race(const board_t &board) {
+    int p1_max = std::numeric_limits<int>::min(), p2_min = std::numeric_limits<int>::max();
+    for (mask_t m = board.pieces[0]; m; m &= m - 1) {
+        auto[x, y] = to_point(mask_ctz(m));
+        p1_max = std::max(x + y, p1_max);
+    }
+    for (mask_t m = board.pieces[1]; m; m &= m - 1) {
+        auto[x, y] = to_point(mask_ctz(m));
+        p2_min = std::min(x + y, p2_min);
+    }
+    return p1_max < p2_min;
+}
+
+static void sort_actions(int player, action_t *begin, action_t *end) {
     if (player == 1) {
-        std::sort(actions.begin(), actions.end(), [](const action_t &a1, const action_t &a2) {
+        std::sort(begin, end, [](const action_t &a1, const action_t &a2) {
             int dist1 = a1.end.x + a1.end.y - a1.begin.x - a1.begin.y;
             int dist2 = a2.end.x + a2.end.y - a2.begin.x - a2.begin.y;
             return dist1 < dist2;
         });
     } else {
-        std::sort(actions.begin(), actions.end(), [](const action_t &a1, const action_t &a2) {
+        std::sort(begin, end, [](const action_t &a1, const action_t &a2) {
             int dist1 = a1.end.x + a1.end.y - a1.begin.x - a1.begin.y;
             int dist2 = a2.end.x + a2.end.y - a2.begin.x - a2.begin.y;
             return dist1 > dist2;
@@ -282,126 +433,879 @@ void sort_actions(int player, std::vector<action_t> &actions) {
     }
 }
 
-std::tuple<int, std::vector<action_t>>
-MinMaxAgent::minmax_search(int current_player, chess_t chess,
-                           std::vector<action_t>::const_iterator begin, std::vector<action_t>::const_iterator end,
-                           int alpha, int beta, int depth, int without_opponent) {
-    int val{0}, best_val{std::numeric_limits<int>::min()};
-    std::vector<action_t> best_actions;
-    best_actions.reserve(end - begin);
+// how far an action brings the piece towards the target of player
+static inline int forward_distance(int player, const action_t &action) {
+    int dist = action.begin.x + action.begin.y - action.end.x - action.end.y;
+    return player == 1 ? dist : -dist;
+}
 
+static constexpr int MAX_FORWARD_DISTANCE = 2 * (BOARD_SIZE - 1);
+
+// keep the max_cnt actions going furthest forward, in generation order.
+// an action is kept before a later generated one of the same distance, so the kept set
+// does not depend on how the actions get ordered afterwards.
+static std::size_t truncate_actions(int player, action_t *begin, action_t *end, std::size_t max_cnt) {
+    std::size_t cnt = end - begin;
+    if (cnt <= max_cnt) return cnt;
+
+    std::size_t dist_cnt[2 * MAX_FORWARD_DISTANCE + 1]{};
+    for (auto iter = begin; iter != end; iter++) dist_cnt[forward_distance(player, *iter) + MAX_FORWARD_DISTANCE]++;
+    // all actions above the threshold are kept, and the first few of it
+    int threshold = 2 * MAX_FORWARD_DISTANCE;
+    std::size_t above_cnt = 0;
+    while (above_cnt + dist_cnt[threshold] < max_cnt) above_cnt += dist_cnt[threshold--];
+    std::size_t threshold_cnt = max_cnt - above_cnt;
+
+    auto out = begin;
     for (auto iter = begin; iter != end; iter++) {
-        const auto &action = *iter;
-        // apply current action & resume automatically
-        auto_action_applier applier(chess, action.begin, action.end);
-
-        if (is_finish(current_player, chess)) {
-            // finish game
-            return {value_max + (int) max_search_depth, {action}};
-        } else if (depth == 0) {
-            // evaluate current status
-            val = evaluate_chess(current_player, chess);
-        } else if (without_opponent) {
-            // step into myself
-            auto[v, a] = minmax_normal(current_player, chess, alpha, beta, depth - 1, without_opponent);
-            val = v;
+        int dist = forward_distance(player, *iter) + MAX_FORWARD_DISTANCE;
+        if (dist > threshold || (dist == threshold && threshold_cnt > 0)) {
+            if (dist == threshold) threshold_cnt--;
+            *out++ = *iter;
+        }
+    }
+    return max_cnt;
+}
+
+static inline std::uint32_t pack_action(const action_t &action) {
+    return (std::uint32_t) to_cell(action.begin) << 8u | (std::uint32_t) to_cell(action.end);
+}
+
+static constexpr std::uint32_t NO_KILLER = 0xffffu;
+
+// move the action of the highest score in [0, cnt) to the front
+static inline void select_action(action_t *actions, int *scores, std::size_t cnt) {
+    std::size_t best = 0;
+    for (std::size_t i = 1; i < cnt; i++) {
+        if (scores[i] > scores[best]) best = i;
+    }
+    std::swap(actions[0], actions[best]);
+    std::swap(scores[0], scores[best]);
+}
+
+// tasks queued for a search that may be over before a worker gets to them. a task joins before it touches
+// the search, and none joins after close, so the search only waits for the tasks that are running.
+struct task_group_t {
+    std::mutex mu;
+    std::condition_variable cv;
+    int running{0};
+    bool closed{false};
+
+    bool join() {
+        std::lock_guard<std::mutex> lock(mu);
+        if (closed) return false;
+        running++;
+        return true;
+    }
+
+    void leave() {
+        std::lock_guard<std::mutex> lock(mu);
+        if (--running == 0) cv.notify_all();
+    }
+
+    // no task joins after close, wait for those who did
+    void close() {
+        std::unique_lock<std::mutex> lock(mu);
+        closed = true;
+        cv.wait(lock, [this] { return running == 0; });
+    }
+
+    // close, but wait at most timeout, true if no task is left running
+    bool close_for(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mu);
+        closed = true;
+        return cv.wait_for(lock, timeout, [this] { return running == 0; });
+    }
+};
+
+// a subtree searched for a split point unwinds once any split point above it got a cutoff.
+// split points live in the frame of the owner, which waits for every helper that joined.
+struct split_point_t {
+    const split_point_t *const parent;
+    const board_t board;
+    const action_t *const begin;
+    const std::size_t actions_cnt;
+    const int current_player, beta, depth, without_opponent;
+    const int root_depth; // of the search the split point belongs to, for the ply of the killers
+
+    std::atomic<std::size_t> next{0};
+    std::atomic<int> alpha;
+    std::atomic<bool> cutoff{false};
+
+    // guard the members below
+    std::mutex mu;
+    int best_val;
+    std::size_t best_idx{0};
+    // value each action returned, root only. like in the serial search, an action searched after alpha
+    // passed it only gets a bound, which still ties the best value if it is one.
+    std::vector<int> values;
+
+    split_point_t(const split_point_t *parent, const board_t &board, const action_t *begin, const action_t *end,
+                  int current_player, int alpha, int beta, int depth, int without_opponent, int root_depth,
+                  bool root)
+            : parent(parent), board(board), begin(begin), actions_cnt(end - begin),
+              current_player(current_player), beta(beta), depth(depth), without_opponent(without_opponent),
+              root_depth(root_depth), alpha(alpha), best_val(std::numeric_limits<int>::min()) {
+        if (root) values.assign(actions_cnt, std::numeric_limits<int>::min());
+    }
+};
+
+struct search_counters_t {
+    std::uint64_t nodes{0};
+    std::uint64_t leaves{0};
+    std::uint64_t beta_cutoffs{0};
+    std::uint64_t first_move_cutoffs{0};
+    std::uint64_t tt_probes{0};
+    std::uint64_t tt_hits{0};
+    std::uint64_t re_searches{0};
+    std::uint64_t reductions{0};
+    std::uint64_t futility_prunes{0};
+    std::uint64_t probcut_cutoffs{0};
+};
+
+// every search thread counts on its own and merges into the agent when its task ends
+static thread_local search_counters_t counters;
+
+static thread_local const split_point_t *active_split = nullptr;
+// depth of the root of the search on this thread, the ply of a node is root depth - depth
+static thread_local int search_root_depth = 0;
+// set on the pool threads running lazy smp helper searches
+static thread_local bool lazy_smp_helper = false;
+
+bool MinMaxAgent::is_aborted() const {
+    if (stop_search.load(std::memory_order_relaxed)) return true;
+    if (lazy_smp_helper && stop_helpers.load(std::memory_order_relaxed)) return true;
+    for (auto sp = active_split; sp; sp = sp->parent) {
+        if (sp->cutoff.load(std::memory_order_relaxed)) return true;
+    }
+    return false;
+}
+
+bool MinMaxAgent::should_stop() {
+    static thread_local unsigned int node_cnt = 0;
+    if (is_aborted()) return true;
+    if ((++node_cnt & 1023u) == 0 && std::chrono::steady_clock::now() >= deadline) {
+        stop_search.store(true, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+int MinMaxAgent::search_action(int current_player, board_t &board, const action_t &action,
+                               int alpha, int beta, int depth, int without_opponent, bool &finished) {
+    // apply current action & resume automatically
+    auto_action_applier applier(board, action.begin, action.end);
+
+    finished = is_finish(current_player, board);
+    int val, distance;
+    // the endgame table knows a finish within distance moves, a shorter one may leave its region,
+    // so the finish it leads to only bounds the value from below
+    const bool known = !finished && without_opponent && probe_endgame_db(current_player, board, distance);
+    const int known_val = known ? value_max + (int) max_search_depth - distance : std::numeric_limits<int>::min();
+    if (finished) {
+        // finish game
+        counters.leaves++;
+        return value_max + (int) max_search_depth;
+    } else if (known && (known_val >= beta || depth == 0)) {
+        counters.leaves++;
+        return known_val;
+    } else if (depth == 0) {
+        // evaluate current status
+        counters.leaves++;
+        val = evaluate_chess(current_player, board);
+    } else if (without_opponent) {
+        // step into myself, the window is shifted by the decrease below so that bounds stay bounds
+        val = minmax_normal(current_player, board, alpha + 1, beta + 1, depth - 1, without_opponent);
+    } else {
+        // step into opponent
+        val = -minmax_normal(3 - current_player, board, -beta, -alpha, depth - 1, without_opponent);
+    }
+    // value decrease by depth
+    return std::max(val - 1, known_val);
+}
+
+void MinMaxAgent::record_cutoff(const action_t &action, int depth) {
+    // a deeper subtree refuted more, so its cutoff counts more
+    std::uint32_t from = to_cell(action.begin), to = to_cell(action.end);
+    std::uint32_t h = history[from][to].load(std::memory_order_relaxed) + (depth + 1) * (depth + 1);
+    history[from][to].store(std::min(h, MAX_HISTORY), std::memory_order_relaxed);
+
+    int ply = search_root_depth - depth;
+    if (ply < 0 || ply >= MAX_TIMED_DEPTH) return;
+    std::uint32_t move = pack_action(action);
+    if (killers[ply][0].load(std::memory_order_relaxed) != move) {
+        killers[ply][1].store(killers[ply][0].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        killers[ply][0].store(move, std::memory_order_relaxed);
+    }
+}
+
+void MinMaxAgent::score_actions(int current_player, const action_t *begin, const action_t *end, int depth,
+                                std::uint32_t tt_move, int *scores) const {
+    // the best action of the last visit, then the killers of the ply, then the furthest forward,
+    // the history of the action breaks the tie of the same distance
+    int ply = search_root_depth - depth;
+    bool has_killers = ply >= 0 && ply < MAX_TIMED_DEPTH;
+    std::uint32_t killer0 = has_killers ? killers[ply][0].load(std::memory_order_relaxed) : NO_KILLER;
+    std::uint32_t killer1 = has_killers ? killers[ply][1].load(std::memory_order_relaxed) : NO_KILLER;
+    for (auto iter = begin; iter != end; iter++, scores++) {
+        std::uint32_t move = pack_action(*iter);
+        if (move == tt_move) {
+            *scores = std::numeric_limits<int>::max();
+        } else if (move == killer0) {
+            *scores = std::numeric_limits<int>::max() - 1;
+        } else if (move == killer1) {
+            *scores = std::numeric_limits<int>::max() - 2;
         } else {
-            // step into opponent
-            auto[v, a] = minmax_normal(3 - current_player, chess, -beta, -alpha, depth - 1, without_opponent);
-            val = -v;
+            std::uint32_t h = history[to_cell(iter->begin)][to_cell(iter->end)].load(std::memory_order_relaxed);
+            *scores = (forward_distance(current_player, *iter) + MAX_FORWARD_DISTANCE) * (int) (MAX_HISTORY + 1) +
+                      (int) h;
+        }
+    }
+}
+
+int MinMaxAgent::search_scout(int current_player, board_t &board, const action_t &action,
+                              int alpha, int beta, int depth, int without_opponent, bool &finished, bool null_window,
+                              std::size_t late_idx) {
+    // wins and losses are scored far beyond any margin, a bound near them is left to the full search
+    const bool selective = late_idx > 0 && std::abs(alpha) < value_max / 2;
+    if (selective && enable_futility && !without_opponent && depth > 0 && depth <= (int) max_futility_depth) {
+        // the opponent replies before any gain of ours, so one ply left only needs a small margin
+        auto_action_applier applier(board, action.begin, action.end);
+        finished = is_finish(current_player, board);
+        int val = evaluate_chess(current_player, board) + futility_margin * depth;
+        if (!finished && val <= alpha) {
+            counters.futility_prunes++;
+            // an upper bound, below alpha like any fail low
+            return val - 1;
+        }
+    }
+    if (selective && enable_lmr && depth >= (int) min_lmr_depth && late_idx >= lmr_full_actions) {
+        // a late action rarely beats the earlier ones, prove it cheaper and search deeper only if it does
+        int reduction = (int) lmr_reduction + (late_idx >= lmr_deep_actions ? 1 : 0);
+        int reduced_depth = std::max(depth - reduction, 0);
+        counters.reductions++;
+        int val = search_action(current_player, board, action, alpha, alpha + 1, reduced_depth, without_opponent,
+                                finished);
+        if (finished || is_aborted() || val <= alpha) return val;
+        counters.re_searches++;
+    }
+    // a failed probe costs a full re-search, close to the leaves there is too little below to save for it
+    if (!enable_pvs || !null_window || depth < (int) min_pvs_depth || beta - alpha <= 1) {
+        return search_action(current_player, board, action, alpha, beta, depth, without_opponent, finished);
+    }
+    // only a value above alpha is worth an exact value, a null window proves the common fail low cheaper
+    int val = search_action(current_player, board, action, alpha, alpha + 1, depth, without_opponent, finished);
+    if (finished || is_aborted() || val <= alpha || val >= beta) return val;
+    counters.re_searches++;
+    return search_action(current_player, board, action, alpha, beta, depth, without_opponent, finished);
+}
+
+bool MinMaxAgent::probcut(int current_player, board_t &board, action_t *begin, action_t *end, int *scores,
+                          int beta, int depth, int without_opponent, action_t &cut_action) {
+    // the value of a shallow search is close to that of the full one, so well above beta it fails high anyway
+    const int probcut_beta = beta + probcut_margin;
+    const int probcut_depth = depth - (int) probcut_reduction;
+    if (probcut_depth < 0 || std::abs(beta) >= value_max / 2) return false;
+    std::size_t cnt = std::min<std::size_t>(probcut_actions, end - begin);
+    for (std::size_t i = 0; i < cnt; i++) {
+        // the picked actions stay in front, so the search after a failed probcut meets them in the same order
+        if (scores) select_action(begin + i, scores + i, end - begin - i);
+        bool finished;
+        int val = search_action(current_player, board, begin[i], probcut_beta - 1, probcut_beta, probcut_depth,
+                                without_opponent, finished);
+        if (is_aborted()) return false;
+        if (finished || val >= probcut_beta) {
+            counters.probcut_cutoffs++;
+            cut_action = begin[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+int MinMaxAgent::minmax_search(int current_player, board_t &board, action_t *begin, action_t *end, int *scores,
+                               int alpha, int beta, int depth, int without_opponent,
+                               action_t *best_action, std::vector<action_t> *best_actions) {
+    int best_val{std::numeric_limits<int>::min()};
+
+    for (auto iter = begin; iter != end; iter++) {
+        // pick the most promising action left, a node with an early cutoff never orders the rest
+        if (scores) select_action(iter, scores + (iter - begin), end - iter);
+        const auto &action = *iter;
+        bool finished;
+        // alpha is the best value so far, so an action tying it still gets its exact value for best_actions
+        int val = search_scout(current_player, board, action, alpha, beta, depth, without_opponent, finished,
+                               iter != begin, best_actions ? 0 : iter - begin);
+        // the value of an interrupted subtree is meaningless
+        if (is_aborted()) return 0;
+
+        if (finished) {
+            if (best_action) *best_action = action;
+            if (best_actions) *best_actions = {action};
+            return val;
         }
-        // value decrease by depth
-        val -= 1;
 
         // alpha-beta tuning
         if (val >= beta) {
-            return {beta, {action}};
+            counters.beta_cutoffs++;
+            if (iter == begin) counters.first_move_cutoffs++;
+            record_cutoff(action, depth);
+            if (best_action) *best_action = action;
+            if (best_actions) *best_actions = {action};
+            return beta;
         }
         // update alpha
         if (val > alpha) {
             alpha = val;
         }
-        // update best action
+        // update best action, the root collects the actions tying the best value, a better one starts over
         if (val > best_val) {
             best_val = val;
+            if (best_action) *best_action = action;
+            if (best_actions) best_actions->clear();
         }
-        if (val == best_val) {
-            best_actions.emplace_back(action);
+        if (val == best_val && best_actions) {
+            best_actions->emplace_back(action);
         }
     }
-    return {best_val, best_actions};
+    return best_val;
 }
 
-std::tuple<int, std::vector<action_t>>
-MinMaxAgent::minmax_normal(int current_player, chess_t chess, int alpha, int beta, int depth, int without_opponent) {
-    auto legal_actions = get_legal_action(current_player, chess);
-    int searching_cnt = std::min(max_search_actions_cnt, legal_actions.size());
+void MinMaxAgent::split_worker(split_point_t &sp, board_t &board) {
+    const split_point_t *saved_split = active_split;
+    active_split = &sp;
+    while (!is_aborted()) {
+        std::size_t idx = sp.next.fetch_add(1);
+        if (idx >= sp.actions_cnt) break;
+        const auto &action = sp.begin[idx];
 
-    if (enable_sort_actions) sort_actions(current_player, legal_actions);
+        bool finished;
+        // the eldest brother was searched before the split, so the actions here are all late
+        int val = search_scout(sp.current_player, board, action, sp.alpha.load(), sp.beta, sp.depth,
+                               sp.without_opponent, finished, true, sp.values.empty() ? idx + 1 : 0);
+        if (is_aborted()) break;
 
-    auto begin = legal_actions.begin();
-    auto end = legal_actions.begin() + searching_cnt;
+        std::lock_guard<std::mutex> lock(sp.mu);
+        if (finished || val >= sp.beta) {
+            sp.best_val = finished ? val : sp.beta;
+            sp.best_idx = idx;
+            sp.cutoff = true;
+            break;
+        }
+        // alpha only grows by exact values, so a worker with an older alpha just prunes less
+        if (val > sp.alpha.load()) {
+            sp.alpha.store(val);
+        }
+        if (val > sp.best_val || (val == sp.best_val && idx < sp.best_idx)) {
+            sp.best_val = val;
+            sp.best_idx = idx;
+        }
+        if (!sp.values.empty()) sp.values[idx] = val;
+    }
+    active_split = saved_split;
+}
 
-    return minmax_search(current_player, chess, begin, end, alpha, beta, depth, without_opponent);
+void MinMaxAgent::help_split(split_point_t &sp) {
+    // a thread syncing a task of its own search may be the one stealing this helper, even one of another agent
+    const int saved_root_depth = search_root_depth;
+    const bool saved_lazy_smp_helper = lazy_smp_helper;
+    const search_counters_t saved_counters = counters;
+    search_root_depth = sp.root_depth;
+    lazy_smp_helper = false;
+    counters = {};
+    board_t helper_board = sp.board;
+    split_worker(sp, helper_board);
+    // merge before the task ends, the owner may finish its depth right after the last helper
+    merge_counters(counters);
+    counters = saved_counters;
+    lazy_smp_helper = saved_lazy_smp_helper;
+    search_root_depth = saved_root_depth;
 }
 
-std::tuple<int, std::vector<action_t>>
-MinMaxAgent::minmax_parallel(int current_player, chess_t chess, int alpha, int beta, int depth, int without_opponent) {
-    auto legal_actions = get_legal_action(current_player, chess);
-    int searching_cnt = std::min(max_search_actions_cnt, legal_actions.size());
+void MinMaxAgent::fork_split(split_point_t &sp, board_t &board, std::size_t helpers_cnt) {
+    if (helpers_cnt == 0) {
+        split_worker(sp, board);
+        return;
+    }
+    auto helper = thread_pool::make_task([this, &sp]() { help_split(sp); });
+    pool_tasks->fetch_add(1, std::memory_order_relaxed);
+    search_pool().spawn(helper);
+    fork_split(sp, board, helpers_cnt - 1);
+    // a helper nobody stole comes back here and finds the actions taken
+    search_pool().sync(helper);
+    pool_tasks->fetch_sub(1, std::memory_order_relaxed);
+}
 
-    if (enable_sort_actions) sort_actions(current_player, legal_actions);
+int MinMaxAgent::minmax_split(int current_player, board_t &board, action_t *begin, action_t *end, int *scores,
+                              int alpha, int beta, int depth, int without_opponent,
+                              action_t *best_action, std::vector<action_t> *best_actions) {
+    // the brothers are handed out in order, so order them all
+    if (scores) {
+        for (auto iter = begin; iter != end; iter++) select_action(iter, scores + (iter - begin), end - iter);
+    }
 
-    size_t n_cpu = std::thread::hardware_concurrency();
-    size_t part = searching_cnt / n_cpu;
-    size_t remain = searching_cnt - part * n_cpu;
+    // an immediate win ends the node, look for it first so that workers never race for it
+    for (auto iter = begin; iter != end; iter++) {
+        auto_action_applier applier(board, iter->begin, iter->end);
+        if (is_finish(current_player, board)) {
+            if (best_action) *best_action = *iter;
+            if (best_actions) *best_actions = {*iter};
+            return value_max + (int) max_search_depth;
+        }
+    }
 
-    size_t idx = 0;
-    std::future<std::tuple<int, std::vector<action_t>>> futures[n_cpu];
-    for (int i = 0; i < n_cpu; i++) {
-        auto begin = legal_actions.begin() + idx;
-        idx += part + (i < remain ? 1 : 0);
-        auto end = legal_actions.begin() + idx;
-        futures[i] = pool.enqueue([&](auto p, auto c, auto b, auto e, auto v1, auto v2, auto d, auto w) {
-            int chess_copy[10][10];
-            memcpy(chess_copy, c, sizeof(int[10][10]));
-            return minmax_search(p, chess_copy, b, e, v1, v2, d, w);
-        }, player, chess, begin, end, alpha, beta, depth, without_opponent);
+    // young brothers wait: the eldest brother is searched alone to get a good alpha
+    if (end - begin < 2) {
+        return minmax_search(current_player, board, begin, end, nullptr, alpha, beta, depth, without_opponent,
+                             best_action, best_actions);
+    }
+    bool finished;
+    int first_val = search_action(current_player, board, *begin, alpha, beta, depth, without_opponent, finished);
+    if (is_aborted()) return 0;
+    if (best_action) *best_action = *begin;
+    if (best_actions) *best_actions = {*begin};
+    if (first_val >= beta) {
+        counters.beta_cutoffs++;
+        counters.first_move_cutoffs++;
+        record_cutoff(*begin, depth);
+        return beta;
     }
 
-    int best_val{std::numeric_limits<int>::min()};
-    std::vector<action_t> best_actions;
-    best_actions.reserve(legal_actions.size());
-    for (int i = 0; i < n_cpu; i++) {
-        auto[val, actions] = futures[i].get();
-        if (val > best_val) {
-            best_val = val;
-            best_actions.clear();
+    split_point_t sp(active_split, board, begin + 1, end, current_player, std::max(alpha, first_val), beta, depth,
+                     without_opponent, search_root_depth, best_actions != nullptr);
+    const std::size_t helpers_cnt = std::min<std::size_t>({sp.actions_cnt - 1, pool_size(), free_pool_tasks()});
+    if (pool) {
+        // the dynamic pool has no fork-join, a queued helper may get a worker only after the split is over
+        auto helpers = std::make_shared<task_group_t>();
+        for (std::size_t i = 0; i < helpers_cnt; i++) {
+            enqueue_task([this, helpers, &sp]() {
+                if (!helpers->join()) return;
+                help_split(sp);
+                helpers->leave();
+            });
         }
-        if (val == best_val) {
-            best_actions.insert(best_actions.end(), actions.begin(), actions.end());
+        split_worker(sp, board);
+        helpers->close();
+    } else {
+        fork_split(sp, board, helpers_cnt);
+    }
+
+    if (is_aborted()) return 0;
+    if (sp.cutoff) {
+        counters.beta_cutoffs++;
+        record_cutoff(sp.begin[sp.best_idx], depth);
+        if (best_action) *best_action = sp.begin[sp.best_idx];
+        if (best_actions) *best_actions = {sp.begin[sp.best_idx]};
+        return sp.best_val;
+    }
+    int best_val = first_val;
+    if (sp.best_val > first_val) {
+        best_val = sp.best_val;
+        if (best_action) *best_action = sp.begin[sp.best_idx];
+    }
+    if (best_actions) {
+        // replay the serial bookkeeping in action order
+        int val = first_val;
+        for (std::size_t i = 0; i < sp.actions_cnt; i++) {
+            if (sp.values[i] > val) {
+                val = sp.values[i];
+                best_actions->clear();
+            }
+            if (sp.values[i] == val) best_actions->emplace_back(sp.begin[i]);
         }
     }
+    return best_val;
+}
+
+int MinMaxAgent::minmax_normal(int current_player, board_t &board, int alpha, int beta, int depth,
+                               int without_opponent, std::vector<action_t> *best_actions) {
+    // a node returns beta or more on fail high, less than alpha on fail low, an exact value otherwise.
+    // entries are only reused at the same depth, a value depends on the depth through the per-ply decrease.
+    if (should_stop()) return 0;
+    counters.nodes++;
+
+    const std::uint64_t key = search_key(board, current_player, without_opponent);
+    tt_entry_t entry;
+    const bool tt_hit = tt.probe(key, entry);
+    counters.tt_probes++;
+    if (tt_hit) counters.tt_hits++;
+    if (tt_hit && !best_actions && entry.depth == depth) {
+        if (entry.bound == bound_t::exact) return entry.value;
+        if (entry.bound == bound_t::lower && entry.value >= beta) return beta;
+        if (entry.bound == bound_t::upper && entry.value < alpha) return entry.value;
+    }
+
+    action_list_t legal_actions;
+    generate_actions(current_player, board, legal_actions);
+    auto begin = legal_actions.begin();
+    auto end = begin + (enable_sort_actions
+                        ? truncate_actions(current_player, begin, legal_actions.end(), max_search_actions_cnt)
+                        : std::min(max_search_actions_cnt, legal_actions.size()));
+
+    const bool has_tt_move = tt_hit && entry.move_begin >= 0;
+    int scores[MAX_LEGAL_ACTIONS];
+    if (enable_sort_actions) {
+        score_actions(current_player, begin, end, depth,
+                      has_tt_move ? (std::uint32_t) entry.move_begin << 8u | (std::uint32_t) entry.move_end : NO_KILLER,
+                      scores);
+    } else if (has_tt_move) {
+        // search the best action of the last visit first
+        auto iter = std::find_if(begin, end, [&](const action_t &a) {
+            return to_cell(a.begin) == entry.move_begin && to_cell(a.end) == entry.move_end;
+        });
+        if (iter != end) std::rotate(begin, iter, iter + 1);
+    }
+
+    action_t best_action{{-1, -1}, {-1, -1}};
+    int val;
+    if (enable_probcut && !best_actions && !without_opponent && depth >= (int) min_probcut_depth &&
+        probcut(current_player, board, begin, end, enable_sort_actions ? scores : nullptr, beta, depth,
+                without_opponent, best_action)) {
+        val = beta;
+    } else if (split_search && depth >= (int) min_split_depth) {
+        val = minmax_split(current_player, board, begin, end, enable_sort_actions ? scores : nullptr,
+                           alpha, beta, depth, without_opponent, &best_action, best_actions);
+    } else {
+        val = minmax_search(current_player, board, begin, end, enable_sort_actions ? scores : nullptr,
+                            alpha, beta, depth, without_opponent, &best_action, best_actions);
+    }
 
-    return {best_val, best_actions};
+    if (begin != end && !is_aborted()) {
+        entry.value = val;
+        entry.depth = depth;
+        entry.bound = val >= beta ? bound_t::lower : val >= alpha ? bound_t::exact : bound_t::upper;
+        entry.move_begin = best_action.begin.x < 0 ? -1 : to_cell(best_action.begin);
+        entry.move_end = best_action.end.x < 0 ? -1 : to_cell(best_action.end);
+        tt.store(key, entry);
+    }
+    return val;
 }
 
-std::tuple<int, action_t> MinMaxAgent::run_normal(chess_t chess) {
-    bool without_opponent = enable_without_opponent && is_without_opponent(chess);
-    int depth = without_opponent ? max_search_depth_without_opponent : max_search_depth;
-    auto[val, best_actions] = minmax_normal(player, chess, value_min, value_max, depth, without_opponent);
+void MinMaxAgent::merge_counters(search_counters_t &c) {
+    std::lock_guard<std::mutex> lock(stats_mu);
+    stats.nodes += c.nodes;
+    stats.leaves += c.leaves;
+    stats.beta_cutoffs += c.beta_cutoffs;
+    stats.first_move_cutoffs += c.first_move_cutoffs;
+    stats.tt_probes += c.tt_probes;
+    stats.tt_hits += c.tt_hits;
+    stats.re_searches += c.re_searches;
+    stats.reductions += c.reductions;
+    stats.futility_prunes += c.futility_prunes;
+    stats.probcut_cutoffs += c.probcut_cutoffs;
+    c = {};
+}
+
+void MinMaxAgent::finish_depth(int depth, std::chrono::steady_clock::time_point depth_start) {
+    merge_counters(counters);
+    if (depth < 0 || depth >= MAX_TIMED_DEPTH) return;
+    std::lock_guard<std::mutex> lock(stats_mu);
+    // the nodes not counted by an earlier depth belong to this one
+    std::uint64_t searched = stats.nodes + stats.leaves;
+    for (int d = 0; d < depth; d++) searched -= stats.depth_nodes[d];
+    stats.completed_depth = depth;
+    stats.depth_ms[depth] = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - depth_start).count();
+    stats.depth_nodes[depth] = searched;
+}
 
+void MinMaxAgent::finish_search(std::chrono::steady_clock::time_point search_start) {
+    merge_counters(counters);
+    std::lock_guard<std::mutex> lock(stats_mu);
+    stats.total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - search_start).count();
+    if (stats.beta_cutoffs) stats.first_move_cutoff_rate = (double) stats.first_move_cutoffs / stats.beta_cutoffs;
+    // depth d searches d + 1 plies
+    if (stats.completed_depth >= 0) {
+        int depth = stats.completed_depth;
+        stats.effective_branching_factor = std::pow((double) stats.depth_nodes[depth], 1.0 / (depth + 1));
+    }
+}
+
+void MinMaxAgent::publish_stats() {
+    std::lock_guard<std::mutex> lock(stats_mu);
+    last_stats = stats;
+}
+
+search_stats_t MinMaxAgent::search_stats() const {
+    std::lock_guard<std::mutex> lock(stats_mu);
+    return last_stats;
+}
+
+void MinMaxAgent::start_search(std::chrono::steady_clock::time_point search_deadline, bool split) {
+    counters = {};
+    stats = {};
+    // killers belong to the positions of the last search, the history fades out
+    for (auto &ply_killers : killers) {
+        for (auto &killer : ply_killers) killer.store(NO_KILLER, std::memory_order_relaxed);
+    }
+    for (auto &from : history) {
+        for (auto &h : from) h.store(h.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+    }
+    tt.new_search();
+    deadline = search_deadline;
+    stop_search = false;
+    split_search = split;
+}
+
+action_t MinMaxAgent::pick_action(const std::vector<action_t> &best_actions) {
     std::uniform_int_distribution<size_t> u(0, best_actions.size() - 1);
-    return {val, best_actions[u(e)]};
+    return best_actions[u(rng)];
+}
+
+std::shared_ptr<task_group_t> MinMaxAgent::start_helpers(const board_t &board, int max_depth, int without_opponent) {
+    if (search_mode != search_mode_t::lazy_smp) return nullptr;
+    stop_helpers = false;
+    auto helpers = std::make_shared<task_group_t>();
+    const std::size_t helpers_cnt = std::min(lazy_smp_helpers_cnt, free_pool_tasks());
+    for (std::size_t id = 1; id <= helpers_cnt; id++) {
+        enqueue_task([this, helpers](board_t board, std::size_t id, int max_depth, int without_opponent) {
+            if (!helpers->join()) return;
+            lazy_smp_helper = true;
+            // odd helpers run one ply ahead, so the table gets the next depth of the main search early
+            for (int depth = (int) (id & 1); depth <= max_depth && !is_aborted(); depth++) {
+                search_root_depth = depth;
+                minmax_normal(player, board, -value_inf, value_inf, depth, without_opponent);
+            }
+            merge_counters(counters);
+            lazy_smp_helper = false;
+            helpers->leave();
+        }, board, id, max_depth, without_opponent);
+    }
+    return helpers;
+}
+
+void MinMaxAgent::stop_helpers_and_wait(const std::shared_ptr<task_group_t> &helpers) {
+    if (!helpers) return;
+    stop_helpers = true;
+    helpers->close();
 }
 
-std::tuple<int, action_t> MinMaxAgent::run_parallel(chess_t chess) {
-    bool without_opponent = enable_without_opponent && is_without_opponent(chess);
+bool MinMaxAgent::run_book(const board_t &board, std::tuple<int, action_t> &result) {
+    action_t action;
+    int value;
+    if (!enable_opening_book || !probe_opening_book(player, board, action, value)) return false;
+    stats.book_move = 1;
+    result = {value, action};
+    return true;
+}
+
+bool MinMaxAgent::run_race(const board_t &board, std::chrono::steady_clock::time_point solve_deadline,
+                           std::tuple<int, action_t> &result) {
+    if (!enable_without_opponent || !enable_race_solver || !is_race(board)) return false;
+    const mask_t pieces = board.pieces[player - 1], special = board.special & pieces;
+    // the rest of a shortest finish is still one as long as our pieces are where it left them,
+    // unless a moved opponent piece now blocks its next action
+    bool follow_plan = race_plan.size() >= 2 && pieces == race_plan_pieces && special == race_plan_special;
+    if (follow_plan) {
+        action_list_t legal_actions;
+        generate_actions(player, board, legal_actions);
+        follow_plan = std::any_of(legal_actions.begin(), legal_actions.end(), [&](const action_t &a) {
+            return a.begin == race_plan[1].begin && a.end == race_plan[1].end;
+        });
+    }
+    if (follow_plan) {
+        race_plan.erase(race_plan.begin());
+    } else {
+        race_plan.clear();
+        bool solved = race.solve(player, board, solve_deadline, race_plan);
+        stats.race_nodes = race.nodes();
+        if (!solved || race_plan.empty()) return false;
+    }
+
+    board_t next = board;
+    apply_action(next, race_plan.front());
+    race_plan_pieces = next.pieces[player - 1];
+    race_plan_special = next.special & race_plan_pieces;
+    // scored like the search without opponent, a finish in one action is value_max + max_search_depth
+    result = {value_max + (int) max_search_depth - (int) race_plan.size() + 1, race_plan.front()};
+    return true;
+}
+
+std::tuple<int, action_t> MinMaxAgent::run_fixed(board_t board, bool split) {
+    const int pondered_depth = finish_ponder(board);
+    const auto start = std::chrono::steady_clock::now();
+    start_search(std::chrono::steady_clock::time_point::max(), split);
+    stats.ponder_depth = pondered_depth;
+    std::tuple<int, action_t> book_result;
+    if (run_book(board, book_result)) return book_result;
+    std::tuple<int, action_t> race_result;
+    if (run_race(board, std::chrono::steady_clock::time_point::max(), race_result)) return race_result;
+    bool without_opponent = enable_without_opponent && is_without_opponent(board);
     int depth = without_opponent ? max_search_depth_without_opponent : max_search_depth;
-    auto[val, best_actions] = minmax_parallel(player, chess, value_min, value_max, depth, without_opponent);
+    auto helpers = start_helpers(board, depth + 1, without_opponent);
+    std::vector<action_t> best_actions;
+    search_root_depth = depth;
+    int val = minmax_normal(player, board, -value_inf, value_inf, depth, without_opponent, &best_actions);
+    finish_depth(depth, start);
+    stop_helpers_and_wait(helpers);
+    finish_search(start);
+    return {val, pick_action(best_actions)};
+}
 
-    std::uniform_int_distribution<size_t> u(0, best_actions.size() - 1);
-    return {val, best_actions[u(e)]};
+std::tuple<int, action_t> MinMaxAgent::run_normal(board_t board) {
+    auto result = run_fixed(board, false);
+    publish_stats();
+    return result;
 }
 
+std::tuple<int, action_t> MinMaxAgent::run_parallel(board_t board) {
+    auto result = run_fixed(board, true);
+    publish_stats();
+    return result;
+}
+
+std::tuple<int, action_t> MinMaxAgent::run(board_t board) {
+    return search_mode == search_mode_t::ybwc ? run_parallel(board) : run_normal(board);
+}
+
+std::tuple<int, action_t> MinMaxAgent::run_timed(board_t board, std::chrono::milliseconds budget) {
+    const int pondered_depth = finish_ponder(board);
+    auto result = run_iterative(board, budget, pondered_depth, MAX_TIMED_DEPTH - 1);
+    publish_stats();
+    return result;
+}
+
+std::tuple<int, action_t> MinMaxAgent::run_deepening(board_t board, int depth) {
+    const int pondered_depth = finish_ponder(board);
+    auto result = run_iterative(board, std::chrono::hours(24), pondered_depth, std::min(depth, MAX_TIMED_DEPTH - 1));
+    publish_stats();
+    return result;
+}
+
+std::tuple<int, action_t> MinMaxAgent::run_iterative(board_t board, std::chrono::milliseconds budget,
+                                                     int pondered_depth, int max_depth) {
+    const auto start = std::chrono::steady_clock::now();
+    start_search(start + budget, search_mode == search_mode_t::ybwc);
+    stats.ponder_depth = pondered_depth;
+    std::tuple<int, action_t> book_result;
+    if (run_book(board, book_result)) return book_result;
+    // leave the search half of the budget in case the solver gives up
+    std::tuple<int, action_t> race_result;
+    if (run_race(board, start + budget / 2, race_result)) return race_result;
+    std::vector<action_t> best_actions;
+    const int best_val = deepen(board, start, budget, max_depth, best_actions);
+
+    if (best_actions.empty()) {
+        // not even one ply finished in time, fall back to the first legal action
+        action_list_t legal_actions;
+        generate_actions(player, board, legal_actions);
+        if (enable_sort_actions) sort_actions(player, legal_actions.begin(), legal_actions.end());
+        best_actions.assign(legal_actions.begin(), legal_actions.begin() + std::min<std::size_t>(1, legal_actions.size()));
+    }
+
+    return {best_val, pick_action(best_actions)};
+}
+
+int MinMaxAgent::deepen(board_t &board, std::chrono::steady_clock::time_point start, std::chrono::milliseconds budget,
+                        int max_depth, std::vector<action_t> &best_actions) {
+    bool without_opponent = enable_without_opponent && is_without_opponent(board);
+    auto helpers = start_helpers(board, MAX_TIMED_DEPTH, without_opponent);
+
+    int best_val{0};
+    int depth_vals[MAX_TIMED_DEPTH];
+    std::vector<action_t> actions;
+    // depth counts like max_search_depth, so depth 0 already searches one ply
+    for (int depth = 0; depth <= max_depth; depth++) {
+        const auto depth_start = std::chrono::steady_clock::now();
+        search_root_depth = depth;
+        // aspiration: expect a value near the last depth, and widen the side it falls out of.
+        // a win or loss is scored around value_max, not worth guessing.
+        int delta = aspiration_window;
+        int guess = depth >= 2 ? depth_vals[depth - 2] : best_val;
+        bool aspirate = delta > 0 && depth >= 2 && std::abs(guess) < value_max / 2;
+        int alpha = aspirate ? guess - delta : -value_inf;
+        int beta = aspirate ? guess + delta : value_inf;
+        int val;
+        while (true) {
+            actions.clear();
+            val = minmax_normal(player, board, alpha, beta, depth, without_opponent, &actions);
+            if (stop_search) break;
+            if (val < alpha) {
+                delta *= 4;
+                alpha = delta < value_max / 2 ? std::max(guess - delta, -value_inf) : -value_inf;
+            } else if (val >= beta) {
+                delta *= 4;
+                beta = delta < value_max / 2 ? std::min(guess + delta, value_inf) : value_inf;
+            } else {
+                break;
+            }
+            counters.re_searches++;
+        }
+        if (stop_search) break;
+        finish_depth(depth, depth_start);
+        best_val = depth_vals[depth] = val;
+        best_actions.swap(actions);
+        // a found win does not get better by searching deeper
+        if (best_val >= value_max) break;
+        // the next depth costs several times the elapsed time, do not start what can not finish
+        if (std::chrono::steady_clock::now() - start >= budget / 2) break;
+    }
+    stop_helpers_and_wait(helpers);
+    finish_search(start);
+    return best_val;
+}
+
+void MinMaxAgent::ponder(board_t board) {
+    const int opponent = 3 - player;
+    const bool without_opponent = enable_without_opponent && is_without_opponent(board);
+    // the opponent most likely plays the reply our last search expected, else the furthest forward action
+    action_list_t actions;
+    generate_actions(opponent, board, actions);
+    if (actions.size() == 0) return;
+    const action_t *predicted = actions.end();
+    tt_entry_t entry;
+    if (tt.probe(search_key(board, opponent, without_opponent), entry) && entry.move_begin >= 0) {
+        predicted = std::find_if(actions.begin(), actions.end(), [&](const action_t &a) {
+            return to_cell(a.begin) == entry.move_begin && to_cell(a.end) == entry.move_end;
+        });
+    }
+    if (predicted == actions.end()) {
+        predicted = std::max_element(actions.begin(), actions.end(), [&](const action_t &a1, const action_t &a2) {
+            return forward_distance(opponent, a1) < forward_distance(opponent, a2);
+        });
+    }
+    apply_action(board, *predicted);
+    // nothing to think about once the game is over, and the race solver needs no help
+    if (is_finish(opponent, board)) return;
+    if (enable_without_opponent && enable_race_solver && is_race(board)) return;
 
+    ponder_board = board;
+    if (ponder_stopped) return;
+    // until stop_ponder, that also stops the search by stop_search. only the table and the depth are kept,
+    // the action is picked by the search on the position the opponent really leaves.
+    const auto start = std::chrono::steady_clock::now();
+    start_search(start + std::chrono::hours(24), search_mode == search_mode_t::ybwc);
+    std::vector<action_t> best_actions;
+    deepen(board, start, std::chrono::hours(24), MAX_TIMED_DEPTH - 1, best_actions);
+    ponder_depth = stats.completed_depth;
+}
+
+void MinMaxAgent::start_ponder(const board_t &board) {
+    stop_ponder();
+    ponder_stopped = false;
+    ponder_depth = -1;
+    ponder_task = std::make_shared<task_group_t>();
+    // a ponder task that did not get a worker before the next search is dropped, the workers may all be
+    // pondering for other agents until their next search
+    enqueue_task([this, board](std::shared_ptr<task_group_t> task) {
+        if (!task->join()) return;
+        ponder(board);
+        task->leave();
+    }, ponder_task);
+}
+
+void MinMaxAgent::stop_ponder() {
+    if (!ponder_task) return;
+    ponder_stopped = true;
+    // the task may be starting its search, which clears stop_search, so keep setting it until the task ends
+    while (!ponder_task->close_for(std::chrono::milliseconds(1))) stop_search = true;
+    ponder_task.reset();
+}
+
+int MinMaxAgent::finish_ponder(const board_t &board) {
+    if (!ponder_task) return -1;
+    stop_ponder();
+    const bool predicted = ponder_board.pieces[0] == board.pieces[0] && ponder_board.pieces[1] == board.pieces[1] &&
+                           ponder_board.special == board.special;
+    return predicted ? ponder_depth : -1;
+}
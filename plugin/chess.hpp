@@ -8,10 +8,37 @@
 #include <vector>
 #include <limits>
 #include <tuple>
+#include <cstdint>
+#include <initializer_list>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <random>
+#include "dynamic_pool.hpp"
+#include "transposition_table.hpp"
+#include "race_solver.hpp"
+#include "endgame_db.hpp"
+#include "opening_book.hpp"
+#include "board_geometry.hpp"
 
 constexpr int DEFAULT_MAX_DEPTH = 2;
+constexpr std::size_t DEFAULT_TT_SIZE_MB = 16;
+constexpr int MAX_TIMED_DEPTH = 64;
+constexpr std::size_t DEFAULT_RACE_SOLVER_NODES = 1u << 17u;
+constexpr int BOARD_SIZE = geometry::SIZE;
+constexpr int CELL_CNT = geometry::CELL_CNT;
+constexpr int PIECE_CNT = geometry::PIECE_CNT;
+// a piece reaches every empty cell at most once
+constexpr std::size_t MAX_LEGAL_ACTIONS = PIECE_CNT * (CELL_CNT - 2 * PIECE_CNT);
 constexpr int value_min = -(1 << 30);
 constexpr int value_max = (1 << 30);
+// window of a root search, wider than any win value
+constexpr int value_inf = value_max + (1 << 16);
 
 struct point_t {
     int x, y;
@@ -21,30 +48,187 @@ struct action_t {
     point_t begin, end;
 };
 
-using chess_t = int (*)[10];
-using chess_ct = const int (*)[10];
+using chess_t = int (*)[BOARD_SIZE];
+using chess_ct = const int (*)[BOARD_SIZE];
 
-inline point_t operator+(const point_t &p1, const point_t &p2) {
+inline constexpr point_t operator+(const point_t &p1, const point_t &p2) {
     return {p1.x + p2.x, p1.y + p2.y};
 }
 
-inline void operator+=(point_t &p1, const point_t &p2) {
+inline constexpr void operator+=(point_t &p1, const point_t &p2) {
     p1.x += p2.x;
     p1.y += p2.y;
 }
 
-inline bool operator==(const point_t &p1, const point_t &p2) {
+inline constexpr bool operator==(const point_t &p1, const point_t &p2) {
     return p1.x == p2.x && p1.y == p2.y;
 }
 
-inline bool operator!=(const point_t &p1, const point_t &p2) {
+inline constexpr bool operator!=(const point_t &p1, const point_t &p2) {
     return p1.x != p2.x || p1.y != p2.y;
 }
 
-bool is_finish(int player, chess_ct chess);
+// one bit per cell, bit index is x * BOARD_SIZE + y.
+using mask_t = unsigned __int128;
 
-std::vector<action_t> get_legal_action(int player, chess_t chess);
+struct board_t {
+    mask_t pieces[2]{}; // pieces of player 1 and player 2, special pieces included
+    mask_t special{};   // special pieces (3 and 4) of both players
+    std::uint64_t hash{0}; // zobrist hash of the pieces, kept up to date by every applied action
+    int score{0};          // evaluation of player 1 minus that of player 2, kept up to date like hash
+};
+
+inline constexpr int to_cell(const point_t &p) {
+    return p.x * BOARD_SIZE + p.y;
+}
+
+inline constexpr point_t to_point(int cell) {
+    return {cell / BOARD_SIZE, cell % BOARD_SIZE};
+}
+
+inline constexpr mask_t cell_mask(int cell) {
+    return mask_t(1) << cell;
+}
+
+inline constexpr mask_t make_mask(std::initializer_list<point_t> points) {
+    mask_t mask = 0;
+    for (const auto &p : points) mask |= cell_mask(to_cell(p));
+    return mask;
+}
+
+inline constexpr mask_t make_target_mask(int player, bool special) {
+    mask_t mask = 0;
+    for (int cell = 0; cell < CELL_CNT; cell++) {
+        auto[x, y] = to_point(cell);
+        if (special ? geometry::is_special_target(player, x, y) : geometry::is_target(player, x, y)) {
+            mask |= cell_mask(cell);
+        }
+    }
+    return mask;
+}
+
+// target triangle of each player, and the cells of it reserved for special pieces
+inline constexpr mask_t finish_mask[2] = {make_target_mask(1, false), make_target_mask(2, false)};
+inline constexpr mask_t finish_special_mask[2] = {make_target_mask(1, true), make_target_mask(2, true)};
+
+inline int mask_ctz(mask_t m) {
+    auto lo = static_cast<std::uint64_t>(m);
+    return lo ? __builtin_ctzll(lo) : 64 + __builtin_ctzll(static_cast<std::uint64_t>(m >> 64));
+}
+
+inline int mask_msb(mask_t m) {
+    auto hi = static_cast<std::uint64_t>(m >> 64);
+    return hi ? 127 - __builtin_clzll(hi) : 63 - __builtin_clzll(static_cast<std::uint64_t>(m));
+}
+
+inline int mask_popcount(mask_t m) {
+    return __builtin_popcountll(static_cast<std::uint64_t>(m)) +
+           __builtin_popcountll(static_cast<std::uint64_t>(m >> 64));
+}
+
+// fixed-capacity action buffer, meant to live on the caller's stack.
+class action_list_t {
+private:
+    std::size_t _size{0};
+    action_t _actions[MAX_LEGAL_ACTIONS];
+
+public:
+    void push_back(const action_t &action) { _actions[_size++] = action; }
+
+    void clear() { _size = 0; }
+
+    std::size_t size() const { return _size; }
 
+    action_t *begin() { return _actions; }
+
+    action_t *end() { return _actions + _size; }
+
+    const action_t *begin() const { return _actions; }
+
+    const action_t *end() const { return _actions + _size; }
+
+    action_t &operator[](std::size_t i) { return _actions[i]; }
+
+    const action_t &operator[](std::size_t i) const { return _actions[i]; }
+};
+
+board_t to_board(chess_ct chess);
+
+void to_chess(const board_t &board, chess_t chess);
+
+bool is_finish(int player, const board_t &board);
+
+std::vector<action_t> get_legal_action(int player, const board_t &board);
+
+// table driven version of get_legal_action, same actions in the same order.
+void generate_actions(int player, const board_t &board, action_list_t &actions);
+
+// move the piece on action.begin to action.end, keeping hash and score up to date.
+void apply_action(board_t &board, const action_t &action);
+
+// static evaluation of the board for player, read from the running score.
+int evaluate_chess(int player, const board_t &board);
+
+// score of player 1 counted from the pieces, always equal to board.score.
+int evaluate_board(const board_t &board);
+
+// values[i] is evaluate_chess(player, child) after the i-th action of player, without applying the actions.
+void evaluate_children(int player, const board_t &board, const action_t *begin, const action_t *end, int *values);
+
+// run task(0) .. task(n - 1) on the calling thread, which starts with task(0), and the thread pool shared by all
+// searches. a task no worker started yet is taken back by the caller, so busy workers never hold it up.
+void fork_search_tasks(std::size_t n, const std::function<void(std::size_t)> &task);
+
+std::size_t search_pool_size();
+
+// map the table written by endgame_gen, shared by all agents. call it while no search runs.
+bool open_endgame_db(const std::string &path);
+
+// moves of a finish of player, if the home region of player is in the open table. a finish leaving the region may be
+// shorter.
+bool probe_endgame_db(int player, const board_t &board, int &distance);
+
+// map the book written by book_gen, shared by all agents. call it while no search runs.
+bool open_opening_book(const std::string &path);
+
+// the book action of player, if the position is in the open book and the action is legal in it
+bool probe_opening_book(int player, const board_t &board, action_t &action, int &value);
+
+enum class search_mode_t {
+    normal = 0, // single thread
+    ybwc = 1,   // young brothers wait split search on the thread pool
+    lazy_smp = 2, // helper searches on the thread pool share the transposition table with the main search
+};
+
+// counters of the last search, plain data so that the plugin can hand it out as is.
+// lazy smp helpers are counted in the totals only, not in the per-depth numbers.
+struct search_stats_t {
+    std::uint64_t nodes{0};              // searched inner nodes, the root included
+    std::uint64_t leaves{0};             // evaluated or finished positions
+    std::uint64_t beta_cutoffs{0};
+    std::uint64_t first_move_cutoffs{0}; // beta cutoffs by the first searched action
+    std::uint64_t tt_probes{0};
+    std::uint64_t tt_hits{0};
+    std::uint64_t re_searches{0};        // pvs, lmr and aspiration searches repeated with a wider window or deeper
+    std::int32_t completed_depth{-1};    // deepest fully searched depth, -1 if none
+    double first_move_cutoff_rate{0};
+    double effective_branching_factor{0}; // of the deepest completed depth
+    double total_ms{0};
+    double depth_ms[MAX_TIMED_DEPTH]{};   // time spent on each depth
+    std::uint64_t depth_nodes[MAX_TIMED_DEPTH]{}; // nodes and leaves of each depth
+    std::uint64_t race_nodes{0};         // nodes of the race solver
+    std::int32_t ponder_depth{-1};       // depth completed by pondering on the position, -1 if not predicted
+    std::int32_t book_move{0};           // 1 if the action came from the opening book without a search
+    std::uint64_t reductions{0};         // late actions searched shallower first by lmr
+    std::uint64_t futility_prunes{0};    // actions skipped by futility pruning
+    std::uint64_t probcut_cutoffs{0};    // nodes cut by a shallow search above beta
+};
+
+struct search_counters_t;
+
+struct split_point_t;
+
+struct task_group_t;
 
 class MinMaxAgent {
 public:
@@ -53,27 +237,228 @@ public:
     std::size_t max_search_depth_without_opponent{DEFAULT_MAX_DEPTH - 1};
     bool enable_sort_actions{true};
     bool enable_without_opponent{false};
+    search_mode_t search_mode{search_mode_t::normal};
+    // nodes closer to the leaves are not worth a split
+    std::size_t min_split_depth{2};
+    // probe all but the first action with a null window, values stay the same as plain alpha-beta
+    bool enable_pvs{true};
+    // nodes closer to the leaves search every action with the full window
+    std::size_t min_pvs_depth{4};
+    // half width of the window around the value of the last depth in run_timed, 0 searches with a full window
+    int aspiration_window{32};
+    // selectivity below the root. unlike max_search_actions_cnt, which never looks at the actions it cuts,
+    // these only skip or shorten actions that a cheaper look shows to be hopeless, and values are no longer
+    // exactly those of plain alpha-beta.
+    // late move reductions: actions after the first lmr_full_actions of a node at least min_lmr_depth deep
+    // are searched lmr_reduction plies shallower with a null window, and again at full depth if above alpha
+    bool enable_lmr{false};
+    std::size_t min_lmr_depth{2};
+    std::size_t lmr_full_actions{3};
+    std::size_t lmr_reduction{1};
+    // actions from lmr_deep_actions on are reduced one ply more
+    std::size_t lmr_deep_actions{8};
+    // futility pruning: an action but the first, at most max_futility_depth above the leaves, is skipped
+    // if the evaluation after it plus futility_margin per ply left is still not above alpha
+    bool enable_futility{false};
+    std::size_t max_futility_depth{2};
+    int futility_margin{120};
+    // probcut: a node at least min_probcut_depth deep fails high at once if one of its first probcut_actions
+    // actions gets beta + probcut_margin from a search probcut_reduction plies shallower
+    bool enable_probcut{false};
+    std::size_t min_probcut_depth{5};
+    std::size_t probcut_reduction{3};
+    std::size_t probcut_actions{3};
+    int probcut_margin{100};
+    // solve the race once the armies passed each other, needs enable_without_opponent.
+    // the solver gives up after the nodes of set_race_solver_nodes and leaves the action to the search.
+    bool enable_race_solver{true};
+    // play the action of the opening book opened by open_opening_book, if the position is in it
+    bool enable_opening_book{true};
+    // helper threads besides the main search in lazy_smp mode
+    std::size_t lazy_smp_helpers_cnt{std::max(1u, std::thread::hardware_concurrency()) - 1};
+    // tasks of this agent on the pool at once, helpers and splits beyond it are left to the searching thread,
+    // so one of many agents sharing the pool cannot crowd the others out of it
+    std::size_t max_pool_tasks{std::numeric_limits<std::size_t>::max()};
 
 private:
     int player;
+    // breaks ties between equally good actions
+    std::default_random_engine rng{std::random_device{}()};
+    transposition_table tt{DEFAULT_TT_SIZE_MB};
+    race_solver race{DEFAULT_RACE_SOLVER_NODES};
+    // the rest of the last solved race, and our pieces it expects at the next call
+    std::vector<action_t> race_plan;
+    mask_t race_plan_pieces{0}, race_plan_special{0};
+    // a timed search polls the clock every few nodes and unwinds once the deadline passed
+    std::chrono::steady_clock::time_point deadline{std::chrono::steady_clock::time_point::max()};
+    std::atomic<bool> stop_search{false};
+    std::atomic<bool> stop_helpers{false};
+    bool split_search{false};
+    mutable std::mutex stats_mu;
+    search_stats_t stats;
+    // stats of the last run, copied when it returns, so that a ponder filling stats does not show through
+    search_stats_t last_stats;
+    // pondering searches the position after the predicted action of the opponent on the thread pool
+    std::shared_ptr<task_group_t> ponder_task;
+    std::atomic<bool> ponder_stopped{false};
+    board_t ponder_board;
+    int ponder_depth{-1};
+    // move ordering, updated by every search thread without locking.
+    // killers are packed as begin cell << 8 | end cell, history is indexed by begin and end cell.
+    static constexpr std::uint32_t MAX_HISTORY = (1u << 16u) - 1;
+    std::atomic<std::uint32_t> killers[MAX_TIMED_DEPTH][2]{};
+    std::atomic<std::uint32_t> history[CELL_CNT][CELL_CNT]{};
+    // the pool of use_dynamic_pool, null on the pool shared by all searches.
+    // after the members the tasks use, so its destructor finishes the queued tasks before those go.
+    std::unique_ptr<thread_pool::dynamic_pool> pool;
+    // tasks of this agent queued or running on the pool. shared with the tasks, a split helper left in the
+    // queue after its search ended may run once the agent is gone.
+    std::shared_ptr<std::atomic<std::size_t>> pool_tasks{std::make_shared<std::atomic<std::size_t>>(0)};
+
+    bool is_aborted() const;
+
+    // run a helper, split or ponder task on the pool of this agent
+    template<typename Func, typename... Args>
+    std::future<void> enqueue_task(Func &&f, Args &&... args);
+
+    std::size_t pool_size() const;
+
+    // tasks the agent may still put on the pool under max_pool_tasks
+    std::size_t free_pool_tasks() const;
+
+    bool should_stop();
+
+    void start_search(std::chrono::steady_clock::time_point search_deadline, bool split);
+
+    // make the stats of the search that just returned those of search_stats
+    void publish_stats();
+
+    action_t pick_action(const std::vector<action_t> &best_actions);
+
+    // the action of the opening book, if enabled and the position is in it
+    bool run_book(const board_t &board, std::tuple<int, action_t> &result);
+
+    // the next action of the shortest finish, if the position is a race and the solver found one
+    bool run_race(const board_t &board, std::chrono::steady_clock::time_point solve_deadline,
+                  std::tuple<int, action_t> &result);
+
+    std::tuple<int, action_t> run_fixed(board_t board, bool split);
+
+    // add the counters of the calling thread to stats
+    void merge_counters(search_counters_t &counters);
+
+    void finish_depth(int depth, std::chrono::steady_clock::time_point depth_start);
+
+    void finish_search(std::chrono::steady_clock::time_point search_start);
+
+    std::shared_ptr<task_group_t> start_helpers(const board_t &board, int max_depth, int without_opponent);
+
+    // a helper still queued behind busy workers is dropped instead of waited for
+    void stop_helpers_and_wait(const std::shared_ptr<task_group_t> &helpers);
+
+    // remember an action that caused a beta cutoff in the killers and history
+    void record_cutoff(const action_t &action, int depth);
+
+    void score_actions(int current_player, const action_t *begin, const action_t *end, int depth,
+                       std::uint32_t tt_move, int *scores) const;
 
-    std::tuple<int, std::vector<action_t>>
-    minmax_search(int current_player, chess_t chess,
-                  std::vector<action_t>::const_iterator begin, std::vector<action_t>::const_iterator end,
-                  int alpha, int beta, int depth, int without_opponent);
+    // search_action, with a null window first if null_window is set and pvs is enabled.
+    // late_idx is the index of the action in its node, 0 for the first action and the root, which are
+    // never pruned or reduced.
+    int search_scout(int current_player, board_t &board, const action_t &action,
+                     int alpha, int beta, int depth, int without_opponent, bool &finished, bool null_window,
+                     std::size_t late_idx);
 
-    std::tuple<int, std::vector<action_t>>
-    minmax_normal(int current_player, chess_t chess, int alpha, int beta, int depth, int without_opponent);
+    // the probcut test of a node, true with the action that failed high
+    bool probcut(int current_player, board_t &board, action_t *begin, action_t *end, int *scores,
+                 int beta, int depth, int without_opponent, action_t &cut_action);
 
-    std::tuple<int, std::vector<action_t>>
-    minmax_parallel(int current_player, chess_t chess, int alpha, int beta, int depth, int without_opponent);
+    int search_action(int current_player, board_t &board, const action_t &action,
+                      int alpha, int beta, int depth, int without_opponent, bool &finished);
+
+    // best_actions collects all the best actions, only needed by the root.
+    // with scores, actions are picked in the order of their scores, otherwise in the given order.
+    int minmax_search(int current_player, board_t &board, action_t *begin, action_t *end, int *scores,
+                      int alpha, int beta, int depth, int without_opponent,
+                      action_t *best_action = nullptr, std::vector<action_t> *best_actions = nullptr);
+
+    int minmax_normal(int current_player, board_t &board, int alpha, int beta, int depth, int without_opponent,
+                      std::vector<action_t> *best_actions = nullptr);
+
+    int minmax_split(int current_player, board_t &board, action_t *begin, action_t *end, int *scores,
+                     int alpha, int beta, int depth, int without_opponent,
+                     action_t *best_action, std::vector<action_t> *best_actions);
+
+    void split_worker(split_point_t &sp, board_t &board);
+
+    // search the actions of sp on a copy of its board, for a task on a pool thread
+    void help_split(split_point_t &sp);
+
+    // fork helpers_cnt helpers of sp on the search pool, one frame each so that nothing is allocated,
+    // search along with them and sync them all
+    void fork_split(split_point_t &sp, board_t &board, std::size_t helpers_cnt);
+
+    // iterative deepening of run_timed up to max_depth, pondered_depth only goes to the stats
+    std::tuple<int, action_t> run_iterative(board_t board, std::chrono::milliseconds budget, int pondered_depth,
+                                            int max_depth);
+
+    // the depths of run_iterative after start_search, until max_depth or the budget since start runs out.
+    // returns the value and the best actions of the last completed depth, and picks or records no action.
+    int deepen(board_t &board, std::chrono::steady_clock::time_point start, std::chrono::milliseconds budget,
+               int max_depth, std::vector<action_t> &best_actions);
+
+    void ponder(board_t board);
+
+    // stop pondering, and return the depth it completed on board, -1 if it pondered on another position
+    int finish_ponder(const board_t &board);
 
 public:
-    explicit MinMaxAgent(int p) : player(p) {};
+    // builds the search pool first, so it outlives the agent
+    explicit MinMaxAgent(int p) : player(p) { search_pool_size(); };
+
+    ~MinMaxAgent() { stop_ponder(); }
+
+    // 0 disables the transposition table
+    void set_tt_size(std::size_t megabytes) { tt.resize(megabytes); }
+
+    void clear_tt() { tt.clear(); }
+
+    // nodes searched at most by one race solve, 0 disables the solver
+    void set_race_solver_nodes(std::size_t max_nodes) { race.resize(max_nodes); }
+
+    // counters of the last run, run_timed or run_deepening, not of pondering
+    search_stats_t search_stats() const;
+
+    // repeat the choices between equally good actions
+    void set_seed(std::uint32_t seed) { rng.seed(seed); }
+
+    // run the tasks of this agent on a pool of its own, which starts threads while tasks wait, up to max_workers,
+    // and lets those above idle_workers go after idling for idle_timeout. suits a process serving many games
+    // with bursty requests better than the fixed shared pool. 0 max_workers goes back to the shared pool.
+    // call it while no search runs.
+    void use_dynamic_pool(std::size_t max_workers, std::size_t idle_workers, std::chrono::milliseconds idle_timeout);
+
+    // queue depth, workers and task latency of the pool of use_dynamic_pool, all zero on the shared pool
+    thread_pool::dynamic_pool_stats pool_stats() const;
+
+    std::tuple<int, action_t> run_normal(board_t board);
+
+    std::tuple<int, action_t> run_parallel(board_t board);
+
+    // fixed depth search in the configured search_mode
+    std::tuple<int, action_t> run(board_t board);
+
+    // iterative deepening until the budget runs out, returns the result of the last completed depth.
+    std::tuple<int, action_t> run_timed(board_t board, std::chrono::milliseconds budget);
+
+    // the iterative deepening of run_timed up to depth without a time limit, to compare the nodes it searches
+    std::tuple<int, action_t> run_deepening(board_t board, int depth);
 
-    std::tuple<int, action_t> run_normal(chess_t chess);
+    // search in the background until the next run or stop_ponder, board is the position after our action.
+    // the next run reuses the transposition table if the opponent played the predicted action.
+    void start_ponder(const board_t &board);
 
-    std::tuple<int, action_t> run_parallel(chess_t chess);
+    void stop_ponder();
 };
 
 #endif //PLUGIN_CHESS_HPP
@@ -0,0 +1,160 @@
+#include "endgame_db.hpp"
+#include "chess.hpp"
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr int REGION_PIECE_CNT = PIECE_CNT;
+static constexpr int REGION_SPECIAL_CNT = geometry::SPECIAL_CNT;
+static constexpr int REGION_MAX_DISTANCE = geometry::PIECE_ROWS; // x + y of the furthest cell of the region
+static constexpr std::size_t SPECIAL_RANK_CNT = binomial_coefficient(REGION_PIECE_CNT, REGION_SPECIAL_CNT);
+
+// placements are unranked into 32 bit masks, and counted by the 32 bit entry_cnt of the file
+static_assert(endgame_db::REGION_CELL_CNT <= 32 && endgame_db::ENTRY_CNT <= 0xffffffffu,
+              "the endgame table indexes up to six piece rows");
+
+struct endgame_db_header_t {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t entry_cnt;
+};
+
+static constexpr char DB_MAGIC[8] = {'C', 'H', 'K', 'E', 'N', 'D', 'D', 'B'};
+static constexpr std::uint32_t DB_VERSION = 1;
+
+using region_cells_t = std::array<int, endgame_db::REGION_CELL_CNT>;
+
+// cells of the region of player 1 in cell order, those of player 2 are the mirrored ones
+static constexpr region_cells_t make_region_cells() {
+    region_cells_t cells{};
+    int i = 0;
+    for (int cell = 0; cell < CELL_CNT; cell++) {
+        if (cell / BOARD_SIZE + cell % BOARD_SIZE <= REGION_MAX_DISTANCE) cells[i++] = cell;
+    }
+    return cells;
+}
+
+static constexpr region_cells_t region_cells = make_region_cells();
+
+static constexpr mask_t make_region_mask(int player) {
+    mask_t mask = 0;
+    for (int cell : region_cells) mask |= cell_mask(player == 1 ? cell : CELL_CNT - 1 - cell);
+    return mask;
+}
+
+static constexpr mask_t region_mask[2] = {make_region_mask(1), make_region_mask(2)};
+
+using binomial_table_t = std::array<std::array<std::uint32_t, REGION_PIECE_CNT + 1>, endgame_db::REGION_CELL_CNT + 1>;
+
+static constexpr binomial_table_t make_binomial_table() {
+    binomial_table_t c{};
+    for (int n = 0; n <= endgame_db::REGION_CELL_CNT; n++) {
+        c[n][0] = 1;
+        for (int k = 1; k <= REGION_PIECE_CNT && n > 0; k++) c[n][k] = c[n - 1][k - 1] + c[n - 1][k];
+    }
+    return c;
+}
+
+static constexpr binomial_table_t binomial = make_binomial_table();
+
+static_assert(binomial[endgame_db::REGION_CELL_CNT][REGION_PIECE_CNT] * SPECIAL_RANK_CNT == endgame_db::ENTRY_CNT);
+static_assert(binomial[REGION_PIECE_CNT][REGION_SPECIAL_CNT] == SPECIAL_RANK_CNT);
+
+// the combination with the given colex rank, as the set bits of a mask of n bits
+static std::uint32_t unrank_combination(std::uint32_t rank, int n, int k) {
+    std::uint32_t bits = 0;
+    for (; k > 0; k--) {
+        int p = k - 1;
+        while (p + 1 < n && binomial[p + 1][k] <= rank) p++;
+        rank -= binomial[p][k];
+        bits |= 1u << p;
+        n = p;
+    }
+    return bits;
+}
+
+std::size_t endgame_db::index_of(int player, const board_t &board) {
+    const mask_t pieces = board.pieces[player - 1];
+    if (pieces & ~region_mask[player - 1]) return UNKNOWN_INDEX;
+
+    // colex ranks of the occupied cells among the region, and of the special pieces among the occupied cells
+    std::uint32_t occupied_rank = 0, special_rank = 0;
+    int occupied_cnt = 0, special_cnt = 0;
+    for (int i = 0; i < REGION_CELL_CNT; i++) {
+        const mask_t m = cell_mask(player == 1 ? region_cells[i] : CELL_CNT - 1 - region_cells[i]);
+        if (!(pieces & m)) continue;
+        if (board.special & m) special_rank += binomial[occupied_cnt][++special_cnt];
+        occupied_rank += binomial[i][++occupied_cnt];
+    }
+    if (occupied_cnt != REGION_PIECE_CNT || special_cnt != REGION_SPECIAL_CNT) return UNKNOWN_INDEX;
+    return occupied_rank * SPECIAL_RANK_CNT + special_rank;
+}
+
+void endgame_db::placement_of(std::size_t index, board_t &board) {
+    const std::uint32_t occupied = unrank_combination(index / SPECIAL_RANK_CNT, REGION_CELL_CNT, REGION_PIECE_CNT);
+    const std::uint32_t special = unrank_combination(index % SPECIAL_RANK_CNT, REGION_PIECE_CNT, REGION_SPECIAL_CNT);
+    board = board_t{};
+    for (int i = 0, k = 0; i < REGION_CELL_CNT; i++) {
+        if (!(occupied & (1u << i))) continue;
+        board.pieces[0] |= cell_mask(region_cells[i]);
+        if (special & (1u << k++)) board.special |= cell_mask(region_cells[i]);
+    }
+}
+
+bool endgame_db::open(const std::string &path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st{};
+    const std::size_t size = sizeof(endgame_db_header_t) + ENTRY_CNT;
+    if (fstat(fd, &st) != 0 || (std::size_t) st.st_size != size) {
+        ::close(fd);
+        return false;
+    }
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) return false;
+
+    const auto *header = static_cast<const endgame_db_header_t *>(mapping);
+    if (std::memcmp(header->magic, DB_MAGIC, sizeof(DB_MAGIC)) != 0 || header->version != DB_VERSION ||
+        header->entry_cnt != ENTRY_CNT) {
+        munmap(mapping, size);
+        return false;
+    }
+    _mapping = mapping;
+    _mapping_size = size;
+    _distances = static_cast<const std::uint8_t *>(mapping) + sizeof(endgame_db_header_t);
+    return true;
+}
+
+void endgame_db::close() {
+    if (_mapping) munmap(_mapping, _mapping_size);
+    _mapping = nullptr;
+    _mapping_size = 0;
+    _distances = nullptr;
+}
+
+bool endgame_db::probe(int player, const board_t &board, int &distance) const {
+    if (!_distances) return false;
+    // an opponent piece in the region may block or bridge, the table knows neither
+    if (board.pieces[2 - player] & region_mask[player - 1]) return false;
+    const std::size_t index = index_of(player, board);
+    if (index == UNKNOWN_INDEX || _distances[index] == UNKNOWN) return false;
+    distance = _distances[index];
+    return true;
+}
+
+bool endgame_db::write(const std::string &path, const std::uint8_t *distances) {
+    endgame_db_header_t header{};
+    std::memcpy(header.magic, DB_MAGIC, sizeof(DB_MAGIC));
+    header.version = DB_VERSION;
+    header.entry_cnt = ENTRY_CNT;
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(distances), ENTRY_CNT);
+    return (bool) out;
+}
@@ -0,0 +1,62 @@
+#ifndef PLUGIN_ENDGAME_DB_HPP
+#define PLUGIN_ENDGAME_DB_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "board_geometry.hpp"
+
+struct board_t;
+
+inline constexpr std::size_t binomial_coefficient(int n, int k) {
+    std::size_t c = 1;
+    for (int i = 1; i <= k; i++) c = c * (n - k + i) / i;
+    return c;
+}
+
+// moves to finish of every placement of the pieces of a player, three of them special, on the cells
+// of its home region (x + y <= PIECE_ROWS for player 1, mirrored for player 2), 15 cells on the 10 x 10 board.
+// distances count moves ending inside the region only, and assume no opponent piece in the region, so a finish
+// through cells outside it may be shorter.
+class endgame_db {
+public:
+    static constexpr int REGION_CELL_CNT = (geometry::PIECE_ROWS + 1) * (geometry::PIECE_ROWS + 2) / 2;
+    static constexpr std::size_t ENTRY_CNT = binomial_coefficient(REGION_CELL_CNT, geometry::PIECE_CNT) *
+                                             binomial_coefficient(geometry::PIECE_CNT, geometry::SPECIAL_CNT);
+    static constexpr std::uint8_t UNKNOWN = 0xff;
+
+    // rank of a placement, UNKNOWN_INDEX if the pieces are not all in the region
+    static constexpr std::size_t UNKNOWN_INDEX = ENTRY_CNT;
+
+    static std::size_t index_of(int player, const board_t &board);
+
+    // the placement of player 1 with the given rank
+    static void placement_of(std::size_t index, board_t &board);
+
+    endgame_db() = default;
+
+    endgame_db(const endgame_db &) = delete;
+
+    endgame_db &operator=(const endgame_db &) = delete;
+
+    ~endgame_db() { close(); }
+
+    // map a file written by write, false if it is missing or broken
+    bool open(const std::string &path);
+
+    void close();
+
+    bool is_open() const { return _distances != nullptr; }
+
+    // O(1), false if the position is not in the table
+    bool probe(int player, const board_t &board, int &distance) const;
+
+    static bool write(const std::string &path, const std::uint8_t *distances);
+
+private:
+    void *_mapping{nullptr};
+    std::size_t _mapping_size{0};
+    const std::uint8_t *_distances{nullptr};
+};
+
+#endif //PLUGIN_ENDGAME_DB_HPP
@@ -0,0 +1,75 @@
+#include "chess.hpp"
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+// the distance of a placement is one more than the least distance among its children, so every
+// pass settles the placements one move further from the finish, reading only the last pass.
+static std::size_t run_pass(const std::vector<std::uint8_t> &last, std::vector<std::uint8_t> &next,
+                            int distance, unsigned threads_cnt) {
+    std::atomic<std::size_t> settled{0};
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < threads_cnt; t++) {
+        threads.emplace_back([&, t]() {
+            std::size_t cnt = 0;
+            action_list_t actions;
+            board_t board;
+            for (std::size_t index = t; index < endgame_db::ENTRY_CNT; index += threads_cnt) {
+                if (last[index] != endgame_db::UNKNOWN) continue;
+                endgame_db::placement_of(index, board);
+                generate_actions(1, board, actions);
+                for (const auto &action : actions) {
+                    board_t child = board;
+                    apply_action(child, action);
+                    std::size_t child_index = endgame_db::index_of(1, child);
+                    if (child_index != endgame_db::UNKNOWN_INDEX && last[child_index] == distance - 1) {
+                        next[index] = distance;
+                        cnt++;
+                        break;
+                    }
+                }
+            }
+            settled += cnt;
+        });
+    }
+    for (auto &thread : threads) thread.join();
+    return settled;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 2) {
+        std::cout << "usage: " << argv[0] << " [output, default=endgame.db]" << std::endl;
+        return -1;
+    }
+    const std::string path = argc == 2 ? argv[1] : "endgame.db";
+    const unsigned threads_cnt = std::max(std::thread::hardware_concurrency(), 1u);
+
+    std::vector<std::uint8_t> distances(endgame_db::ENTRY_CNT, endgame_db::UNKNOWN);
+    std::size_t settled = 0;
+    for (std::size_t index = 0; index < endgame_db::ENTRY_CNT; index++) {
+        board_t board;
+        endgame_db::placement_of(index, board);
+        if (is_finish(1, board)) {
+            distances[index] = 0;
+            settled++;
+        }
+    }
+    std::cout << "distance 0: " << settled << std::endl;
+
+    for (int distance = 1; distance < endgame_db::UNKNOWN; distance++) {
+        std::vector<std::uint8_t> next = distances;
+        std::size_t cnt = run_pass(distances, next, distance, threads_cnt);
+        if (cnt == 0) break;
+        distances.swap(next);
+        settled += cnt;
+        std::cout << "distance " << distance << ": " << cnt << std::endl;
+    }
+    std::cout << "settled " << settled << " of " << endgame_db::ENTRY_CNT << " placements" << std::endl;
+
+    if (!endgame_db::write(path, distances.data())) {
+        std::cerr << "[ERROR]: can not write " << path << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,33 @@
+// piece-square weights of the evaluation, seen from player 1 moving to the (0, 0) corner.
+// score7 is for normal pieces, score3 for special pieces. `tune fit` writes a replacement of this file.
+
+#ifndef PLUGIN_EVAL_WEIGHTS_HPP
+#define PLUGIN_EVAL_WEIGHTS_HPP
+
+static constexpr int score7[10][10] = {
+        {400, 0,   317, 280, 245, 213, 184, 157, 132, 110},
+        {0,   0,   286, 250, 218, 188, 160, 135, 112, 92},
+        {317, 286, 256, 222, 192, 163, 138, 114, 94,  75},
+        {280, 250, 222, 196, 167, 141, 117, 96,  76,  60},
+        {245, 218, 192, 167, 144, 119, 98,  78,  61,  46},
+        {213, 188, 163, 141, 119, 100, 80,  62,  47,  34},
+        {184, 160, 138, 117, 98,  80,  64,  48,  35,  24},
+        {157, 135, 114, 96,  78,  62,  48,  36,  24,  15},
+        {132, 112, 94,  76,  61,  47,  35,  24,  16,  8},
+        {110, 92,  75,  60,  46,  34,  24,  15,  8,   4},
+};
+
+static constexpr int score3[10][10] = {
+        {0,   357, 100, 280, 245, 213, 184, 157, 132, 110},
+        {357, 324, 286, 250, 218, 188, 160, 135, 112, 92},
+        {100, 286, 256, 222, 192, 163, 138, 114, 94,  75},
+        {280, 250, 222, 196, 167, 141, 117, 96,  76,  60},
+        {245, 218, 192, 167, 144, 119, 98,  78,  61,  46},
+        {213, 188, 163, 141, 119, 100, 80,  62,  47,  34},
+        {184, 160, 138, 117, 98,  80,  64,  48,  35,  24},
+        {157, 135, 114, 96,  78,  62,  48,  36,  24,  15},
+        {132, 112, 94,  76,  61,  47,  35,  24,  16,  8},
+        {110, 92,  75,  60,  46,  34,  24,  15,  8,   4},
+};
+
+#endif //PLUGIN_EVAL_WEIGHTS_HPP
@@ -0,0 +1,180 @@
+#include "evaluation.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define PLUGIN_EVAL_AVX2
+#include <immintrin.h>
+#endif
+
+// cells padded to whole 16 lane groups
+static constexpr int PADDED_CELL_CNT = 128;
+
+// piece_square as 16 bit lanes, the pad cells weigh nothing
+struct padded_weights_t {
+    alignas(32) std::int16_t value[4][PADDED_CELL_CNT];
+};
+
+static constexpr bool weights_fit_int16() {
+    for (const auto &plane : piece_square.value) {
+        for (int w : plane) if (w < -32768 || w > 32767) return false;
+    }
+    return true;
+}
+
+static_assert(weights_fit_int16(), "eval_weights.hpp must fit 16 bits for the simd kernel");
+
+static constexpr padded_weights_t make_padded_weights() {
+    padded_weights_t table{};
+    for (int plane = 0; plane < 4; plane++) {
+        for (int cell = 0; cell < CELL_CNT; cell++) {
+            table.value[plane][cell] = static_cast<std::int16_t>(piece_square.value[plane][cell]);
+        }
+    }
+    return table;
+}
+
+static constexpr padded_weights_t padded_weights = make_padded_weights();
+
+// occupancy of every chess value, in the order of piece_square
+static inline void occupancy_planes(const board_t &board, mask_t planes[4]) {
+    planes[0] = board.pieces[0] & ~board.special;
+    planes[1] = board.pieces[1] & ~board.special;
+    planes[2] = board.pieces[0] & board.special;
+    planes[3] = board.pieces[1] & board.special;
+}
+
+static int evaluate_board_scalar(const board_t &board) {
+    mask_t planes[4];
+    occupancy_planes(board, planes);
+    int score = 0;
+    for (int plane = 0; plane < 4; plane++) {
+        for (mask_t m = planes[plane]; m; m &= m - 1) score += piece_square.value[plane][mask_ctz(m)];
+    }
+    return score;
+}
+
+static void evaluate_children_scalar(int player, const board_t &board, const action_t *begin, const action_t *end,
+                                     int *values) {
+    const int owner = player - 1;
+    for (const action_t *action = begin; action != end; action++, values++) {
+        const int from = to_cell(action->begin), to = to_cell(action->end);
+        const int plane = owner + (board.special & cell_mask(from) ? 2 : 0);
+        const int score = board.score + piece_square.value[plane][to] - piece_square.value[plane][from];
+        *values = player == 1 ? score : -score;
+    }
+}
+
+#ifdef PLUGIN_EVAL_AVX2
+
+// every 16 cells of a plane become 16 lanes of 0 / -1, masking the weights before a multiply-add to 32 bits
+__attribute__((target("avx2")))
+static int evaluate_board_avx2(const board_t &board) {
+    mask_t planes[4];
+    occupancy_planes(board, planes);
+    const __m256i lane_bits = _mm256_setr_epi16(1 << 0, 1 << 1, 1 << 2, 1 << 3, 1 << 4, 1 << 5, 1 << 6, 1 << 7,
+                                                 1 << 8, 1 << 9, 1 << 10, 1 << 11, 1 << 12, 1 << 13, 1 << 14,
+                                                 (short) (1 << 15));
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i sum = _mm256_setzero_si256();
+    for (int plane = 0; plane < 4; plane++) {
+        for (int group = 0; group < PADDED_CELL_CNT / 16; group++) {
+            const auto bits = static_cast<std::uint16_t>(planes[plane] >> (16u * group));
+            if (!bits) continue;
+            const __m256i occupied = _mm256_cmpeq_epi16(_mm256_and_si256(_mm256_set1_epi16((short) bits), lane_bits),
+                                                        lane_bits);
+            const __m256i weights = _mm256_load_si256(
+                    reinterpret_cast<const __m256i *>(padded_weights.value[plane] + 16 * group));
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_and_si256(occupied, weights), ones));
+        }
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(half);
+}
+
+// eight actions a round: the cells are gathered from the actions, the special bit from the words of
+// board.special and the two weights from piece_square, the rest of the actions go the scalar way
+__attribute__((target("avx2")))
+static void evaluate_children_avx2(int player, const board_t &board, const action_t *begin, const action_t *end,
+                                   int *values) {
+    static_assert(sizeof(action_t) == 4 * sizeof(int), "actions are gathered as four ints");
+    std::uint32_t special_words[sizeof(mask_t) / sizeof(std::uint32_t)];
+    std::memcpy(special_words, &board.special, sizeof(special_words));
+
+    const __m256i stride = _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28);
+    const __m256i ten = _mm256_set1_epi32(BOARD_SIZE);
+    const __m256i owner = _mm256_set1_epi32((player - 1) * CELL_CNT);
+    const __m256i special_offset = _mm256_set1_epi32(2 * CELL_CNT);
+    const __m256i one = _mm256_set1_epi32(1), low_bits = _mm256_set1_epi32(31);
+    const __m256i score = _mm256_set1_epi32(board.score);
+    const int *weights = &piece_square.value[0][0];
+
+    const std::size_t cnt = end - begin;
+    std::size_t i = 0;
+    for (; i + 8 <= cnt; i += 8) {
+        const int *base = reinterpret_cast<const int *>(begin + i);
+        const __m256i from = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_i32gather_epi32(base, stride, 4), ten),
+                                              _mm256_i32gather_epi32(base + 1, stride, 4));
+        const __m256i to = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_i32gather_epi32(base + 2, stride, 4), ten),
+                                            _mm256_i32gather_epi32(base + 3, stride, 4));
+        const __m256i word = _mm256_i32gather_epi32(reinterpret_cast<const int *>(special_words),
+                                                    _mm256_srli_epi32(from, 5), 4);
+        const __m256i special = _mm256_and_si256(_mm256_srlv_epi32(word, _mm256_and_si256(from, low_bits)), one);
+        const __m256i plane = _mm256_add_epi32(owner, _mm256_mullo_epi32(special, special_offset));
+        __m256i value = _mm256_sub_epi32(
+                _mm256_add_epi32(score, _mm256_i32gather_epi32(weights, _mm256_add_epi32(plane, to), 4)),
+                _mm256_i32gather_epi32(weights, _mm256_add_epi32(plane, from), 4));
+        if (player != 1) value = _mm256_sub_epi32(_mm256_setzero_si256(), value);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(values + i), value);
+    }
+    evaluate_children_scalar(player, board, begin + i, end, values + i);
+}
+
+#endif
+
+static bool cpu_supports_avx2() {
+#ifdef PLUGIN_EVAL_AVX2
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+bool eval_kernel_supported(eval_kernel_t kernel) {
+    static const bool has_avx2 = cpu_supports_avx2();
+    return kernel == eval_kernel_t::scalar || (kernel == eval_kernel_t::avx2 && has_avx2);
+}
+
+eval_kernel_t eval_kernel() {
+    static const eval_kernel_t kernel = eval_kernel_supported(eval_kernel_t::avx2) ? eval_kernel_t::avx2
+                                                                                   : eval_kernel_t::scalar;
+    return kernel;
+}
+
+const char *eval_kernel_name(eval_kernel_t kernel) {
+    return kernel == eval_kernel_t::avx2 ? "avx2" : "scalar";
+}
+
+int evaluate_board(eval_kernel_t kernel, const board_t &board) {
+#ifdef PLUGIN_EVAL_AVX2
+    if (kernel == eval_kernel_t::avx2) return evaluate_board_avx2(board);
+#endif
+    return evaluate_board_scalar(board);
+}
+
+void evaluate_children(eval_kernel_t kernel, int player, const board_t &board,
+                       const action_t *begin, const action_t *end, int *values) {
+#ifdef PLUGIN_EVAL_AVX2
+    if (kernel == eval_kernel_t::avx2) return evaluate_children_avx2(player, board, begin, end, values);
+#endif
+    evaluate_children_scalar(player, board, begin, end, values);
+}
+
+int evaluate_board(const board_t &board) {
+    return evaluate_board(eval_kernel(), board);
+}
+
+void evaluate_children(int player, const board_t &board, const action_t *begin, const action_t *end, int *values) {
+    evaluate_children(eval_kernel(), player, board, begin, end, values);
+}
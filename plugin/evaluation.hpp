@@ -0,0 +1,65 @@
+#ifndef PLUGIN_EVALUATION_HPP
+#define PLUGIN_EVALUATION_HPP
+
+#include "chess.hpp"
+#include "eval_weights.hpp"
+
+// rows and columns of score7 / score3
+constexpr int WEIGHT_SIZE = sizeof(score7) / sizeof(score7[0]);
+
+// row or column of the weight tables read for a row or column of the board. the three next to either
+// corner keep their own weights, those between are spread over the middle of the tables.
+// the identity when the board is as large as the tables.
+inline constexpr int weight_coordinate(int c) {
+    constexpr int CORNER = 3, MIDDLE = BOARD_SIZE - 2 * CORNER, WEIGHT_MIDDLE = WEIGHT_SIZE - 2 * CORNER;
+    if (c < CORNER) return c;
+    if (c >= BOARD_SIZE - CORNER) return c - BOARD_SIZE + WEIGHT_SIZE;
+    if (MIDDLE == 1) return CORNER + WEIGHT_MIDDLE / 2;
+    return CORNER + ((c - CORNER) * (WEIGHT_MIDDLE - 1) * 2 + MIDDLE - 1) / ((MIDDLE - 1) * 2);
+}
+
+// flat index into score7 / score3 of a cell seen from player 1
+inline constexpr int weight_cell(int cell) {
+    auto[x, y] = to_point(cell);
+    return weight_coordinate(x) * WEIGHT_SIZE + weight_coordinate(y);
+}
+
+// score7 / score3 of every chess value at every cell, seen from player 1
+struct piece_square_table_t {
+    int value[4][CELL_CNT]; // indexed by chess value - 1
+};
+
+static constexpr piece_square_table_t make_piece_square_table() {
+    piece_square_table_t table{};
+    for (int cell = 0; cell < CELL_CNT; cell++) {
+        // player 2 reads the tables from the opposite corner
+        const int own = weight_cell(cell), mirrored = weight_cell(CELL_CNT - 1 - cell);
+        table.value[0][cell] = score7[own / WEIGHT_SIZE][own % WEIGHT_SIZE];
+        table.value[1][cell] = -score7[mirrored / WEIGHT_SIZE][mirrored % WEIGHT_SIZE];
+        table.value[2][cell] = score3[own / WEIGHT_SIZE][own % WEIGHT_SIZE];
+        table.value[3][cell] = -score3[mirrored / WEIGHT_SIZE][mirrored % WEIGHT_SIZE];
+    }
+    return table;
+}
+
+inline constexpr piece_square_table_t piece_square = make_piece_square_table();
+
+enum class eval_kernel_t {
+    scalar = 0,
+    avx2 = 1,
+};
+
+// the kernel evaluate_board and evaluate_children run, the best one the cpu supports
+eval_kernel_t eval_kernel();
+
+bool eval_kernel_supported(eval_kernel_t kernel);
+
+const char *eval_kernel_name(eval_kernel_t kernel);
+
+// evaluate_board / evaluate_children on the given kernel, which must be supported
+int evaluate_board(eval_kernel_t kernel, const board_t &board);
+
+void evaluate_children(eval_kernel_t kernel, int player, const board_t &board,
+                       const action_t *begin, const action_t *end, int *values);
+
+#endif //PLUGIN_EVALUATION_HPP
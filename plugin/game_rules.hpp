@@ -0,0 +1,67 @@
+#ifndef PLUGIN_GAME_RULES_HPP
+#define PLUGIN_GAME_RULES_HPP
+
+#include "chess.hpp"
+
+// game rules of runGame.py / board.py
+constexpr int MAX_STEPS = 200;
+constexpr int BLOCKED_WIN_STEP = 100;
+
+struct chess_table_t {
+    int value[BOARD_SIZE][BOARD_SIZE];
+};
+
+static constexpr chess_table_t make_start_chess() {
+    chess_table_t chess{};
+    for (int x = 0; x < BOARD_SIZE; x++) {
+        for (int y = 0; y < BOARD_SIZE; y++) chess.value[x][y] = geometry::start_value(x, y);
+    }
+    return chess;
+}
+
+constexpr chess_table_t start_chess = make_start_chess();
+
+struct target_scan_t {
+    point_t cells[2][PIECE_CNT];
+};
+
+// target cells in the scan order of Board.ifPlayerWin, row by row of the python board
+static constexpr target_scan_t make_target_scan() {
+    target_scan_t scan{};
+    int i = 0;
+    for (int row = 0; row < geometry::PIECE_ROWS; row++) {
+        for (int x = row; x >= 0; x--) scan.cells[0][i++] = {x, row - x};
+    }
+    i = 0;
+    for (int row = 2 * (BOARD_SIZE - 1) - (geometry::PIECE_ROWS - 1); row <= 2 * (BOARD_SIZE - 1); row++) {
+        for (int x = BOARD_SIZE - 1; x >= row - (BOARD_SIZE - 1); x--) scan.cells[1][i++] = {x, row - x};
+    }
+    return scan;
+}
+
+constexpr target_scan_t target_scan = make_target_scan();
+
+// Board.ifPlayerWin: every target cell holds a piece of player, special pieces only on the special cells.
+// after BLOCKED_WIN_STEP steps, an opponent piece on the first cell that breaks this wins as well.
+inline bool is_python_win(int player, const board_t &board, int step) {
+    const mask_t own = board.pieces[player - 1], opponent = board.pieces[2 - player];
+    for (const auto &p : target_scan.cells[player - 1]) {
+        const mask_t m = cell_mask(to_cell(p));
+        if (own & m) {
+            if (!(board.special & m) || (finish_special_mask[player - 1] & m)) continue;
+        } else if (step > BLOCKED_WIN_STEP && (opponent & m)) {
+            return true;
+        }
+        return false;
+    }
+    return true;
+}
+
+// Board.isEnd, player 1 is checked first
+inline int python_winner(const board_t &board, int step) {
+    if (is_python_win(1, board, step)) return 1;
+    if (is_python_win(2, board, step)) return 2;
+    return 0;
+}
+
+#endif //PLUGIN_GAME_RULES_HPP
@@ -3,13 +3,14 @@
 //
 
 #include "chess.hpp"
+#include "game_rules.hpp"
 #include <iostream>
 #include <chrono>
 #include <cstring>
 
-static void print_chess(int chess[10][10]) {
-    for (int x = 0; x < 10; x++) {
-        for (int y = 0; y < 10; y++) {
+static void print_chess(chess_ct chess) {
+    for (int x = 0; x < BOARD_SIZE; x++) {
+        for (int y = 0; y < BOARD_SIZE; y++) {
             std::cout << chess[x][y] << " ";
         }
         std::cout << std::endl;
@@ -24,13 +25,13 @@ static inline std::ostream &operator<<(std::ostream &out, action_t a) {
     return out << a.begin << "-->" << a.end;
 }
 
-static bool is_max_only(int chess[10][10]) {
+static bool is_max_only(chess_ct chess) {
     int p1_min = std::numeric_limits<int>::max();
     int p1_max = std::numeric_limits<int>::min();
     int p2_min = std::numeric_limits<int>::max();
     int p2_max = std::numeric_limits<int>::min();
-    for (int x = 0; x < 10; x++) {
-        for (int y = 0; y < 10; y++) {
+    for (int x = 0; x < BOARD_SIZE; x++) {
+        for (int y = 0; y < BOARD_SIZE; y++) {
             if (chess[x][y] == 1 || chess[x][y] == 3) {
                 p1_min = std::min(x + y, p1_min);
                 p1_max = std::max(x + y, p1_max);
@@ -69,34 +70,23 @@ int main(int argc, char *argv[]) {
     agent2.enable_sort_actions = true;
     agent2.enable_without_opponent = true;
 
-    int chess[10][10] = {
-            //0,1, 2, 3, 4, 5, 6, 7, 8, 9
-            {2, 4, 2, 2, 0, 0, 0, 0, 0, 0}, // 0
-            {4, 4, 2, 0, 0, 0, 0, 0, 0, 0}, // 1
-            {2, 2, 0, 0, 0, 0, 0, 0, 0, 0}, // 2
-            {2, 0, 0, 0, 0, 0, 0, 0, 0, 0}, // 3
-            {0, 0, 0, 0, 0, 0, 0, 0, 0, 0}, // 4
-            {0, 0, 0, 0, 0, 0, 0, 0, 0, 0}, // 5
-            {0, 0, 0, 0, 0, 0, 0, 0, 0, 1}, // 6
-            {0, 0, 0, 0, 0, 0, 0, 0, 1, 1}, // 7
-            {0, 0, 0, 0, 0, 0, 0, 1, 3, 3}, // 8
-            {0, 0, 0, 0, 0, 0, 1, 1, 3, 1}, // 9
-    };
+    agent1.search_mode = agent2.search_mode = normal_mode ? search_mode_t::normal : search_mode_t::ybwc;
+
+    int chess[BOARD_SIZE][BOARD_SIZE];
+    std::memcpy(chess, start_chess.value, sizeof(chess));
 
     int player = 1;
     int step = 0;
     int val;
     action_t best_action{};
-    while (!is_finish(1, chess) && !is_finish(2, chess)) {
+    while (!is_finish(1, to_board(chess)) && !is_finish(2, to_board(chess))) {
         step += 1;
-        if (step > 200) return -1;
+        if (step > MAX_STEPS) return -1;
         auto t1 = std::chrono::system_clock::now();
         if (player == 1) {
-//            std::tie(val, best_action) = agent1.run_parallel(chess);
-            std::tie(val, best_action) = agent1.run_normal(chess);
+            std::tie(val, best_action) = agent1.run(to_board(chess));
         } else {
-//            std::tie(val, best_action) = agent2.run_parallel(chess);
-            std::tie(val, best_action) = agent2.run_normal(chess);
+            std::tie(val, best_action) = agent2.run(to_board(chess));
         }
         auto t2 = std::chrono::system_clock::now();
 
@@ -121,7 +111,7 @@ int main(int argc, char *argv[]) {
 
         player = 3 - player;
     }
-    if (is_finish(1, chess)) {
+    if (is_finish(1, to_board(chess))) {
         std::cout << "player-1 win in " << step << " steps." << std::endl;
     } else {
         std::cout << "player-2 win in " << step << " steps." << std::endl;
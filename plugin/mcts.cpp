@@ -0,0 +1,221 @@
+#include "mcts.hpp"
+#include <cmath>
+#include <random>
+#include <thread>
+#include <vector>
+
+// iterations deeper than this stop selecting and roll out
+static constexpr std::size_t MAX_TREE_PATH = 256;
+
+static thread_local std::minstd_rand rollout_rng(
+        std::random_device{}() ^ (unsigned) std::hash<std::thread::id>{}(std::this_thread::get_id()));
+
+void mcts_node_pool::resize(std::size_t capacity) {
+    capacity = std::min<std::size_t>(capacity, mcts_node_t::NONE);
+    _nodes.reset(capacity ? new mcts_node_t[capacity] : nullptr);
+    _capacity = capacity;
+    _used = 0;
+}
+
+void mcts_node_pool::reset() {
+    // nodes past used were never handed out since the last reset
+    for (std::size_t i = 0, used_cnt = used(); i < used_cnt; i++) {
+        auto &node = _nodes[i];
+        node.state.store(mcts_node_t::unexpanded, std::memory_order_relaxed);
+        node.children_cnt.store(0, std::memory_order_relaxed);
+        node.first_child.store(mcts_node_t::NONE, std::memory_order_relaxed);
+        node.visits.store(0, std::memory_order_relaxed);
+        node.reward_sum.store(0, std::memory_order_relaxed);
+    }
+    _used = 0;
+}
+
+std::uint32_t mcts_node_pool::allocate(std::size_t cnt) {
+    std::size_t first = _used.fetch_add(cnt, std::memory_order_relaxed);
+    if (first + cnt > _capacity) return mcts_node_t::NONE;
+    return static_cast<std::uint32_t>(first);
+}
+
+std::uint32_t MCTSAgent::new_root() {
+    std::uint32_t index = nodes.allocate(1);
+    if (index != mcts_node_t::NONE) nodes[index].mover = static_cast<std::int8_t>(3 - player);
+    return index;
+}
+
+bool MCTSAgent::expand(std::uint32_t index, int current_player, const board_t &board) {
+    auto &node = nodes[index];
+    std::uint8_t state = mcts_node_t::unexpanded;
+    if (!node.state.compare_exchange_strong(state, mcts_node_t::expanding, std::memory_order_acq_rel)) {
+        return state == mcts_node_t::expanded;
+    }
+    action_list_t actions;
+    generate_actions(current_player, board, actions);
+    // a full pool leaves the node a leaf, its iterations roll out from it
+    std::uint32_t first = actions.size() ? nodes.allocate(actions.size()) : mcts_node_t::NONE;
+    if (first != mcts_node_t::NONE) {
+        for (std::size_t i = 0; i < actions.size(); i++) {
+            auto &child = nodes[first + i];
+            child.action = actions[i];
+            child.mover = static_cast<std::int8_t>(current_player);
+        }
+        node.first_child.store(first, std::memory_order_relaxed);
+        node.children_cnt.store(static_cast<std::uint16_t>(actions.size()), std::memory_order_relaxed);
+    }
+    node.state.store(mcts_node_t::expanded, std::memory_order_release);
+    return true;
+}
+
+std::uint32_t MCTSAgent::select_child(std::uint32_t index) {
+    auto &node = nodes[index];
+    const std::uint32_t first = node.first_child.load(std::memory_order_relaxed);
+    const std::uint32_t cnt = node.children_cnt.load(std::memory_order_relaxed);
+    const double log_visits = std::log(std::max(node.visits.load(std::memory_order_relaxed), 1));
+    std::uint32_t best = first;
+    double best_score = -std::numeric_limits<double>::infinity();
+    for (std::uint32_t i = first; i < first + cnt; i++) {
+        auto &child = nodes[i];
+        const std::int32_t visits = child.visits.load(std::memory_order_relaxed);
+        // every action is tried once before any is tried twice
+        if (visits <= 0) return i;
+        const double mean = (double) child.reward_sum.load(std::memory_order_relaxed) / ((double) visits * REWARD_SCALE);
+        const double score = mean + exploration * std::sqrt(log_visits / visits);
+        if (score > best_score) {
+            best_score = score;
+            best = i;
+        }
+    }
+    return best;
+}
+
+std::int64_t MCTSAgent::rollout(int current_player, board_t board) {
+    std::uniform_real_distribution<double> explore(0, 1);
+    action_list_t actions;
+    for (int ply = 0; ply < max_rollout_depth; ply++) {
+        generate_actions(current_player, board, actions);
+        if (actions.size() == 0) break;
+
+        std::size_t pick = 0;
+        if (explore(rollout_rng) < rollout_epsilon) {
+            pick = std::uniform_int_distribution<std::size_t>(0, actions.size() - 1)(rollout_rng);
+        } else {
+            // the highest score after the action, ties broken at random
+            int scores[MAX_LEGAL_ACTIONS];
+            evaluate_children(current_player, board, actions.begin(), actions.end(), scores);
+            int best_score = std::numeric_limits<int>::min();
+            std::size_t ties = 0;
+            for (std::size_t i = 0; i < actions.size(); i++) {
+                const int score = scores[i];
+                if (score > best_score) {
+                    best_score = score;
+                    pick = i;
+                    ties = 1;
+                } else if (score == best_score) {
+                    if (std::uniform_int_distribution<std::size_t>(0, ties++)(rollout_rng) == 0) pick = i;
+                }
+            }
+        }
+        apply_action(board, actions[pick]);
+        if (is_finish(current_player, board)) return current_player == 1 ? REWARD_SCALE : -REWARD_SCALE;
+        current_player = 3 - current_player;
+    }
+    return static_cast<std::int64_t>(std::tanh((double) board.score / rollout_score_scale) * REWARD_SCALE);
+}
+
+void MCTSAgent::iterate(std::uint32_t root, const board_t &board) {
+    const int loss = parallel_mode == mcts_parallel_t::tree && helpers_cnt ? virtual_loss : 0;
+    std::uint32_t path[MAX_TREE_PATH];
+    std::size_t path_len = 0;
+    board_t curr = board;
+    int current_player = player;
+    std::uint32_t index = root;
+    bool terminal = false;
+
+    auto enter = [&](std::uint32_t i) {
+        // a pending iteration counts as lost, so that other threads spread over the siblings
+        nodes[i].visits.fetch_add(loss, std::memory_order_relaxed);
+        nodes[i].reward_sum.fetch_sub(loss * REWARD_SCALE, std::memory_order_relaxed);
+        path[path_len++] = i;
+    };
+    enter(root);
+    while (path_len < MAX_TREE_PATH) {
+        auto &node = nodes[index];
+        // a node is expanded at its second visit, the root at once
+        bool visited = node.visits.load(std::memory_order_relaxed) > loss;
+        if (node.state.load(std::memory_order_acquire) != mcts_node_t::expanded &&
+            !((visited || index == root) && expand(index, current_player, curr))) {
+            break;
+        }
+        if (node.children_cnt.load(std::memory_order_relaxed) == 0) break;
+
+        index = select_child(index);
+        enter(index);
+        apply_action(curr, nodes[index].action);
+        if (is_finish(current_player, curr)) {
+            terminal = true;
+            break;
+        }
+        current_player = 3 - current_player;
+    }
+
+    std::int64_t reward = terminal ? (current_player == 1 ? REWARD_SCALE : -REWARD_SCALE)
+                                   : rollout(current_player, curr);
+    for (std::size_t i = 0; i < path_len; i++) {
+        auto &node = nodes[path[i]];
+        node.visits.fetch_add(1 - loss, std::memory_order_relaxed);
+        node.reward_sum.fetch_add((node.mover == 1 ? reward : -reward) + loss * REWARD_SCALE,
+                                  std::memory_order_relaxed);
+    }
+}
+
+void MCTSAgent::grow(std::uint32_t root, const board_t &board, std::size_t max_cnt) {
+    if (root == mcts_node_t::NONE) return;
+    while (iterations.fetch_add(1, std::memory_order_relaxed) < max_cnt &&
+           std::chrono::steady_clock::now() < deadline) {
+        iterate(root, board);
+    }
+}
+
+std::tuple<int, action_t> MCTSAgent::search(const board_t &board, std::size_t max_cnt) {
+    if (nodes.capacity() != max_nodes) nodes.resize(max_nodes);
+    nodes.reset();
+    iterations = 0;
+    const std::size_t threads_cnt = std::min(helpers_cnt, search_pool_size()) + 1;
+    std::vector<std::uint32_t> roots;
+    for (std::size_t i = 0; i < (parallel_mode == mcts_parallel_t::root ? threads_cnt : 1); i++) {
+        roots.push_back(new_root());
+    }
+
+    // a helper taken back by this thread finds the iterations or the time used up
+    fork_search_tasks(threads_cnt, [&](std::size_t id) { grow(roots[id % roots.size()], board, max_cnt); });
+    iterations = std::min(iterations.load(), max_cnt);
+
+    // the most visited action, summed over the trees of root parallelism.
+    // every root generated the same actions in the same order.
+    std::vector<std::int64_t> visits, rewards;
+    action_list_t actions;
+    generate_actions(player, board, actions);
+    visits.assign(actions.size(), 0);
+    rewards.assign(actions.size(), 0);
+    for (std::uint32_t root : roots) {
+        if (root == mcts_node_t::NONE || nodes[root].children_cnt.load() != actions.size()) continue;
+        const std::uint32_t first = nodes[root].first_child.load();
+        for (std::size_t i = 0; i < actions.size(); i++) {
+            visits[i] += nodes[first + i].visits.load();
+            rewards[i] += nodes[first + i].reward_sum.load();
+        }
+    }
+    if (actions.size() == 0) return {0, action_t{}};
+    std::size_t best = std::max_element(visits.begin(), visits.end()) - visits.begin();
+    int value = visits[best] ? (int) (rewards[best] / visits[best]) : 0;
+    return {value, actions[best]};
+}
+
+std::tuple<int, action_t> MCTSAgent::run(board_t board) {
+    deadline = std::chrono::steady_clock::time_point::max();
+    return search(board, max_iterations);
+}
+
+std::tuple<int, action_t> MCTSAgent::run_timed(board_t board, std::chrono::milliseconds budget) {
+    deadline = std::chrono::steady_clock::now() + budget;
+    return search(board, std::numeric_limits<std::size_t>::max());
+}
@@ -0,0 +1,120 @@
+#ifndef PLUGIN_MCTS_HPP
+#define PLUGIN_MCTS_HPP
+
+#include "chess.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <tuple>
+
+constexpr std::size_t DEFAULT_MCTS_NODES = 1u << 20u;
+constexpr std::size_t DEFAULT_MCTS_ITERATIONS = 20000;
+
+enum class mcts_parallel_t {
+    tree = 0, // all threads grow one tree, kept apart by virtual loss
+    root = 1, // every thread grows its own tree, the visits of the root actions are summed
+};
+
+struct mcts_node_t {
+    static constexpr std::uint32_t NONE = 0xffffffffu;
+    enum : std::uint8_t {
+        unexpanded = 0, expanding, expanded
+    };
+
+    action_t action{};  // the action from the parent
+    std::int8_t mover{0}; // player of that action, rewards are summed from its side
+    std::atomic<std::uint8_t> state{unexpanded};
+    std::atomic<std::uint16_t> children_cnt{0};
+    std::atomic<std::uint32_t> first_child{NONE};
+    std::atomic<std::int32_t> visits{0};
+    std::atomic<std::int64_t> reward_sum{0}; // in 1 / REWARD_SCALE
+};
+
+// fixed-capacity node storage, the children of a node are allocated in one block.
+// allocation is a single atomic add, nodes are only freed all together by reset.
+class mcts_node_pool {
+private:
+    std::unique_ptr<mcts_node_t[]> _nodes;
+    std::size_t _capacity{0};
+    std::atomic<std::size_t> _used{0};
+
+public:
+    explicit mcts_node_pool(std::size_t capacity = 0) { resize(capacity); }
+
+    void resize(std::size_t capacity);
+
+    void reset();
+
+    // index of the first of cnt new nodes, mcts_node_t::NONE if the pool is full
+    std::uint32_t allocate(std::size_t cnt);
+
+    mcts_node_t &operator[](std::uint32_t index) { return _nodes[index]; }
+
+    std::size_t capacity() const { return _capacity; }
+
+    std::size_t used() const { return std::min(_used.load(std::memory_order_relaxed), _capacity); }
+};
+
+class MCTSAgent {
+public:
+    static constexpr std::int64_t REWARD_SCALE = 1000;
+
+    // iterations of run, run_timed searches until the budget runs out
+    std::size_t max_iterations{DEFAULT_MCTS_ITERATIONS};
+    // exploration constant of UCT
+    double exploration{0.7};
+    // plies of a rollout before the score decides it
+    int max_rollout_depth{16};
+    // rollouts play the action raising the score most, or a random one at this rate
+    double rollout_epsilon{0.1};
+    // score difference worth about three quarters of a win at the end of a rollout
+    int rollout_score_scale{400};
+    // visits added to the path of a running iteration in tree parallelism
+    int virtual_loss{3};
+    mcts_parallel_t parallel_mode{mcts_parallel_t::tree};
+    // nodes of the tree, allocated at the first search
+    std::size_t max_nodes{DEFAULT_MCTS_NODES};
+    // threads on the search pool besides the caller, 0 searches single threaded
+    std::size_t helpers_cnt{std::max(1u, std::thread::hardware_concurrency()) - 1};
+
+private:
+    int player;
+    mcts_node_pool nodes;
+    std::chrono::steady_clock::time_point deadline{std::chrono::steady_clock::time_point::max()};
+    std::atomic<std::size_t> iterations{0};
+
+    std::uint32_t new_root();
+
+    // expand node once, later callers see its children or a pending expansion
+    bool expand(std::uint32_t index, int current_player, const board_t &board);
+
+    std::uint32_t select_child(std::uint32_t index);
+
+    // reward of player 1, in [-REWARD_SCALE, REWARD_SCALE]
+    std::int64_t rollout(int current_player, board_t board);
+
+    void iterate(std::uint32_t root, const board_t &board);
+
+    // iterate until max_cnt iterations of all threads or the deadline
+    void grow(std::uint32_t root, const board_t &board, std::size_t max_cnt);
+
+    std::tuple<int, action_t> search(const board_t &board, std::size_t max_cnt);
+
+public:
+    // builds the search pool first, so it outlives the agent
+    explicit MCTSAgent(int p) : player(p) { search_pool_size(); };
+
+    // iterations and nodes of the last search
+    std::size_t search_iterations() const { return iterations.load(std::memory_order_relaxed); }
+
+    std::size_t search_nodes() const { return nodes.used(); }
+
+    // value is the expected result of the action, in thousandths of a win
+    std::tuple<int, action_t> run(board_t board);
+
+    std::tuple<int, action_t> run_timed(board_t board, std::chrono::milliseconds budget);
+};
+
+#endif //PLUGIN_MCTS_HPP
@@ -0,0 +1,96 @@
+#include "opening_book.hpp"
+#include "chess.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(CELL_CNT <= 256, "book actions store cells in a byte");
+static_assert(sizeof(book_move_t) == 4, "book actions are packed into 4 bytes");
+
+struct opening_book_header_t {
+    char magic[8];
+    std::uint32_t version;
+    std::uint16_t board_size; // the geometry the hashes are of
+    std::uint16_t piece_rows;
+    std::uint32_t depth;      // of the searches that found the actions
+    std::uint32_t entry_cnt;
+};
+
+static constexpr char BOOK_MAGIC[8] = {'C', 'H', 'K', 'B', 'O', 'O', 'K', '\0'};
+static constexpr std::uint32_t BOOK_VERSION = 1;
+
+// the zobrist hash does not know whose turn it is, both players may reach the same pieces
+static constexpr std::uint64_t PLAYER2_KEY = 0x9e3779b97f4a7c15ull;
+
+std::uint64_t opening_book::key_of(int player, const board_t &board) {
+    return board.hash ^ (player == 2 ? PLAYER2_KEY : 0);
+}
+
+bool opening_book::open(const std::string &path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || (std::size_t) st.st_size < sizeof(opening_book_header_t)) {
+        ::close(fd);
+        return false;
+    }
+    const auto size = (std::size_t) st.st_size;
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) return false;
+
+    const auto *header = static_cast<const opening_book_header_t *>(mapping);
+    const std::size_t entry_cnt = header->entry_cnt;
+    if (std::memcmp(header->magic, BOOK_MAGIC, sizeof(BOOK_MAGIC)) != 0 || header->version != BOOK_VERSION ||
+        header->board_size != geometry::SIZE || header->piece_rows != geometry::PIECE_ROWS ||
+        size != sizeof(opening_book_header_t) + entry_cnt * (sizeof(std::uint64_t) + sizeof(book_move_t))) {
+        munmap(mapping, size);
+        return false;
+    }
+    _mapping = mapping;
+    _mapping_size = size;
+    _entry_cnt = entry_cnt;
+    _keys = reinterpret_cast<const std::uint64_t *>(static_cast<const char *>(mapping) + sizeof(opening_book_header_t));
+    _moves = reinterpret_cast<const book_move_t *>(_keys + entry_cnt);
+    return true;
+}
+
+void opening_book::close() {
+    if (_mapping) munmap(_mapping, _mapping_size);
+    _mapping = nullptr;
+    _mapping_size = 0;
+    _entry_cnt = 0;
+    _keys = nullptr;
+    _moves = nullptr;
+}
+
+bool opening_book::probe(int player, const board_t &board, book_move_t &move) const {
+    if (!_keys) return false;
+    const std::uint64_t key = key_of(player, board);
+    const std::uint64_t *it = std::lower_bound(_keys, _keys + _entry_cnt, key);
+    if (it == _keys + _entry_cnt || *it != key) return false;
+    move = _moves[it - _keys];
+    return true;
+}
+
+bool opening_book::write(const std::string &path, const std::vector<std::uint64_t> &keys,
+                         const std::vector<book_move_t> &moves, int depth) {
+    if (keys.size() != moves.size() || !std::is_sorted(keys.begin(), keys.end())) return false;
+    opening_book_header_t header{};
+    std::memcpy(header.magic, BOOK_MAGIC, sizeof(BOOK_MAGIC));
+    header.version = BOOK_VERSION;
+    header.board_size = geometry::SIZE;
+    header.piece_rows = geometry::PIECE_ROWS;
+    header.depth = depth;
+    header.entry_cnt = keys.size();
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(keys.data()), keys.size() * sizeof(std::uint64_t));
+    out.write(reinterpret_cast<const char *>(moves.data()), moves.size() * sizeof(book_move_t));
+    return (bool) out;
+}
@@ -0,0 +1,58 @@
+#ifndef PLUGIN_OPENING_BOOK_HPP
+#define PLUGIN_OPENING_BOOK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct board_t;
+
+// the action of a book position, cells as in to_cell, value as seen by the player to move
+struct book_move_t {
+    std::uint8_t begin;
+    std::uint8_t end;
+    std::int16_t value;
+};
+
+// best actions of positions near the start, found by deep searches of book_gen.
+// the file holds the sorted keys of all positions, followed by their actions in the same order,
+// so a probe is a binary search over the mapped keys.
+class opening_book {
+public:
+    // the position with player to move, hash collisions are left to the caller checking the action is legal
+    static std::uint64_t key_of(int player, const board_t &board);
+
+    opening_book() = default;
+
+    opening_book(const opening_book &) = delete;
+
+    opening_book &operator=(const opening_book &) = delete;
+
+    ~opening_book() { close(); }
+
+    // map a file written by write, false if it is missing, broken, or of another board
+    bool open(const std::string &path);
+
+    void close();
+
+    bool is_open() const { return _keys != nullptr; }
+
+    std::size_t size() const { return _entry_cnt; }
+
+    // O(log n), false if the position is not in the book
+    bool probe(int player, const board_t &board, book_move_t &move) const;
+
+    // keys must be sorted and unique, moves[i] is the action of keys[i]. depth is the search depth, for the header.
+    static bool write(const std::string &path, const std::vector<std::uint64_t> &keys,
+                      const std::vector<book_move_t> &moves, int depth);
+
+private:
+    void *_mapping{nullptr};
+    std::size_t _mapping_size{0};
+    std::size_t _entry_cnt{0};
+    const std::uint64_t *_keys{nullptr};
+    const book_move_t *_moves{nullptr};
+};
+
+#endif //PLUGIN_OPENING_BOOK_HPP
@@ -3,34 +3,233 @@
 //
 
 #include "chess.hpp"
+#include "mcts.hpp"
 
 static MinMaxAgent agents[2] = {MinMaxAgent{1}, MinMaxAgent{2}};
+static MCTSAgent mcts_agents[2] = {MCTSAgent{1}, MCTSAgent{2}};
 
 extern "C" void init_agent(int player, int max_search_depth, int max_search_depth_without_opponent,
-                           int max_search_actions_cnt, bool enable_sort_actions, bool enable_without_opponent) {
+                           int max_search_actions_cnt, bool enable_sort_actions, bool enable_without_opponent,
+                           int tt_size_mb, int search_mode) {
     agents[player - 1].max_search_depth = max_search_depth;
     agents[player - 1].max_search_actions_cnt = max_search_actions_cnt;
     agents[player - 1].max_search_depth_without_opponent = max_search_depth_without_opponent;
     agents[player - 1].enable_sort_actions = enable_sort_actions;
     agents[player - 1].enable_without_opponent = enable_without_opponent;
+    agents[player - 1].search_mode = static_cast<search_mode_t>(search_mode);
+    // entries depend on the settings above, so always start from an empty table
+    agents[player - 1].set_tt_size(tt_size_mb);
 }
 
-extern "C" void alpha_beta_minmax(int player, int chess[10][10], int best_actions[2][2]) {
-    auto[val, action] = agents[player - 1].run_normal(chess);
-//    auto[val, action] = agents[player - 1].run_parallel(chess);
+extern "C" void alpha_beta_minmax(int player, int chess[BOARD_SIZE][BOARD_SIZE], int best_actions[2][2]) {
+    auto[val, action] = agents[player - 1].run(to_board(chess));
     best_actions[0][0] = action.begin.x;
     best_actions[0][1] = action.begin.y;
     best_actions[1][0] = action.end.x;
     best_actions[1][1] = action.end.y;
 }
 
-extern "C" void get_actions(int player, int chess[10][10], int actions[200][2][2], int *actions_cnt) {
-    *actions_cnt = 0;
-    for (const auto &a: get_legal_action(player, chess)) {
-        actions[*actions_cnt][0][0] = a.begin.x;
-        actions[*actions_cnt][0][1] = a.begin.y;
-        actions[*actions_cnt][1][0] = a.end.x;
-        actions[*actions_cnt][1][1] = a.end.y;
-        (*actions_cnt)++;
+extern "C" void alpha_beta_minmax_timed(int player, int chess[BOARD_SIZE][BOARD_SIZE], int budget_ms, int best_actions[2][2]) {
+    auto[val, action] = agents[player - 1].run_timed(to_board(chess), std::chrono::milliseconds(budget_ms));
+    best_actions[0][0] = action.begin.x;
+    best_actions[0][1] = action.begin.y;
+    best_actions[1][0] = action.end.x;
+    best_actions[1][1] = action.end.y;
+}
+
+extern "C" void init_mcts_agent(int player, int max_iterations, int max_nodes, int parallel_mode) {
+    mcts_agents[player - 1].max_iterations = max_iterations;
+    mcts_agents[player - 1].max_nodes = max_nodes;
+    mcts_agents[player - 1].parallel_mode = static_cast<mcts_parallel_t>(parallel_mode);
+}
+
+// budget_ms > 0 searches until the budget runs out, otherwise for max_iterations
+extern "C" void mcts_search(int player, int chess[BOARD_SIZE][BOARD_SIZE], int budget_ms, int best_actions[2][2]) {
+    auto[val, action] = budget_ms > 0
+                        ? mcts_agents[player - 1].run_timed(to_board(chess), std::chrono::milliseconds(budget_ms))
+                        : mcts_agents[player - 1].run(to_board(chess));
+    best_actions[0][0] = action.begin.x;
+    best_actions[0][1] = action.begin.y;
+    best_actions[1][0] = action.end.x;
+    best_actions[1][1] = action.end.y;
+}
+
+extern "C" bool load_endgame_db(const char *path) {
+    return open_endgame_db(path);
+}
+
+extern "C" bool load_opening_book(const char *path) {
+    return open_opening_book(path);
+}
+
+// chess is the board after the action of player, the next alpha_beta_minmax(_timed) of player stops pondering
+extern "C" void start_ponder(int player, int chess[BOARD_SIZE][BOARD_SIZE]) {
+    agents[player - 1].start_ponder(to_board(chess));
+}
+
+extern "C" void stop_ponder() {
+    for (auto &agent : agents) agent.stop_ponder();
+}
+
+extern "C" void get_search_stats(int player, search_stats_t *stats) {
+    *stats = agents[player - 1].search_stats();
+}
+
+// max_workers > 0 gives the agent of player an elastic pool of its own, 0 puts it back on the shared pool
+extern "C" void set_search_pool(int player, int max_workers, int idle_workers, int idle_timeout_ms) {
+    agents[player - 1].use_dynamic_pool(std::max(max_workers, 0), std::max(idle_workers, 0),
+                                        std::chrono::milliseconds(std::max(idle_timeout_ms, 0)));
+}
+
+extern "C" void get_pool_stats(int player, thread_pool::dynamic_pool_stats *stats) {
+    *stats = agents[player - 1].pool_stats();
+}
+
+// the functions above drive one agent per player, enough for a single game. engines below are independent
+// agents, each with its own transposition table and random engine, on the search pool shared by all of them,
+// so one process can host many games at once. calls on different engines may run on different threads,
+// calls on one engine must not overlap.
+
+// settings of create_engine, plain data so that python can fill it in
+struct engine_config_t {
+    std::int32_t player;
+    std::int32_t max_search_depth;
+    std::int32_t max_search_depth_without_opponent;
+    std::int32_t max_search_actions_cnt;
+    std::int32_t enable_sort_actions;
+    std::int32_t enable_without_opponent;
+    std::int32_t tt_size_mb;
+    std::int32_t search_mode;
+    std::int32_t max_pool_tasks; // tasks of the engine on the shared pool at once, 0 for no limit
+    std::uint32_t seed;          // of the choice between equally good actions, 0 for a random one
+    std::int32_t enable_lmr;     // selectivity below the root, see MinMaxAgent
+    std::int32_t enable_futility;
+    std::int32_t enable_probcut;
+};
+
+struct engine_t {
+    MinMaxAgent agent;
+
+    explicit engine_t(int player) : agent(player) {}
+};
+
+// null if the player is neither 1 nor 2
+extern "C" engine_t *create_engine(const engine_config_t *config) {
+    if (config->player != 1 && config->player != 2) return nullptr;
+    auto *engine = new engine_t(config->player);
+    MinMaxAgent &agent = engine->agent;
+    agent.max_search_depth = config->max_search_depth;
+    agent.max_search_depth_without_opponent = config->max_search_depth_without_opponent;
+    agent.max_search_actions_cnt = config->max_search_actions_cnt;
+    agent.enable_sort_actions = config->enable_sort_actions != 0;
+    agent.enable_without_opponent = config->enable_without_opponent != 0;
+    agent.search_mode = static_cast<search_mode_t>(config->search_mode);
+    agent.enable_lmr = config->enable_lmr != 0;
+    agent.enable_futility = config->enable_futility != 0;
+    agent.enable_probcut = config->enable_probcut != 0;
+    if (config->max_pool_tasks > 0) agent.max_pool_tasks = config->max_pool_tasks;
+    if (config->seed != 0) agent.set_seed(config->seed);
+    agent.set_tt_size(config->tt_size_mb);
+    return engine;
+}
+
+// stops pondering first
+extern "C" void destroy_engine(engine_t *engine) {
+    delete engine;
+}
+
+// budget_ms > 0 searches by iterative deepening within the budget, otherwise to the configured depth
+extern "C" void engine_move(engine_t *engine, int chess[BOARD_SIZE][BOARD_SIZE], int budget_ms, int best_actions[2][2]) {
+    auto[val, action] = budget_ms > 0
+                        ? engine->agent.run_timed(to_board(chess), std::chrono::milliseconds(budget_ms))
+                        : engine->agent.run(to_board(chess));
+    best_actions[0][0] = action.begin.x;
+    best_actions[0][1] = action.begin.y;
+    best_actions[1][0] = action.end.x;
+    best_actions[1][1] = action.end.y;
+}
+
+extern "C" void engine_start_ponder(engine_t *engine, int chess[BOARD_SIZE][BOARD_SIZE]) {
+    engine->agent.start_ponder(to_board(chess));
+}
+
+extern "C" void engine_stop_ponder(engine_t *engine) {
+    engine->agent.stop_ponder();
+}
+
+extern "C" void engine_search_stats(engine_t *engine, search_stats_t *stats) {
+    *stats = engine->agent.search_stats();
+}
+
+extern "C" void engine_set_search_pool(engine_t *engine, int max_workers, int idle_workers, int idle_timeout_ms) {
+    engine->agent.use_dynamic_pool(std::max(max_workers, 0), std::max(idle_workers, 0),
+                                   std::chrono::milliseconds(std::max(idle_timeout_ms, 0)));
+}
+
+extern "C" void engine_pool_stats(engine_t *engine, thread_pool::dynamic_pool_stats *stats) {
+    *stats = engine->agent.pool_stats();
+}
+
+// writes at most max_actions_cnt actions, actions_cnt is the count of all legal actions
+extern "C" void get_actions(int player, int chess[BOARD_SIZE][BOARD_SIZE], int actions[][2][2], int max_actions_cnt, int *actions_cnt) {
+    action_list_t legal_actions;
+    generate_actions(player, to_board(chess), legal_actions);
+    *actions_cnt = (int) legal_actions.size();
+    for (int i = 0; i < std::min(*actions_cnt, max_actions_cnt); i++) {
+        actions[i][0][0] = legal_actions[i].begin.x;
+        actions[i][0][1] = legal_actions[i].begin.y;
+        actions[i][1][0] = legal_actions[i].end.x;
+        actions[i][1][1] = legal_actions[i].end.y;
     }
 }
+
+// run f(0) .. f(n - 1) on the caller and the search thread pool, in contiguous chunks
+template<typename Func>
+static void parallel_for(int n, const Func &f) {
+    static constexpr int MIN_CHUNK_SIZE = 64;
+    const int chunks_cnt = std::max(1, std::min<int>(n / MIN_CHUNK_SIZE, (int) search_pool_size()));
+    fork_search_tasks(chunks_cnt, [&f, n, chunks_cnt](std::size_t c) {
+        const int begin = (int) ((long long) n * c / chunks_cnt), end = (int) ((long long) n * (c + 1) / chunks_cnt);
+        for (int i = begin; i < end; i++) f(i);
+    });
+}
+
+static inline chess_ct batch_chess(const int *boards, int i) {
+    return reinterpret_cast<chess_ct>(boards + (std::size_t) i * CELL_CNT);
+}
+
+// boards holds n chess boards one after another, players the player to move on each.
+// the actions of board i are actions[offsets[i]] .. actions[offsets[i + 1] - 1], at most max_actions_cnt in all.
+// returns the count of all actions, or -1 if they do not fit, in which case offsets are still filled
+// so the caller can size the buffer and call again.
+extern "C" int get_actions_batch(int n, const int *boards, const int *players,
+                                 int actions[][2][2], int max_actions_cnt, int *offsets) {
+    parallel_for(n, [&](int i) {
+        action_list_t legal_actions;
+        generate_actions(players[i], to_board(batch_chess(boards, i)), legal_actions);
+        offsets[i + 1] = (int) legal_actions.size();
+    });
+    offsets[0] = 0;
+    for (int i = 0; i < n; i++) offsets[i + 1] += offsets[i];
+    if (offsets[n] > max_actions_cnt) return -1;
+
+    parallel_for(n, [&](int i) {
+        action_list_t legal_actions;
+        generate_actions(players[i], to_board(batch_chess(boards, i)), legal_actions);
+        for (std::size_t k = 0; k < legal_actions.size(); k++) {
+            auto &action = actions[offsets[i] + k];
+            action[0][0] = legal_actions[k].begin.x;
+            action[0][1] = legal_actions[k].begin.y;
+            action[1][0] = legal_actions[k].end.x;
+            action[1][1] = legal_actions[k].end.y;
+        }
+    });
+    return offsets[n];
+}
+
+// values[i] is evaluate_chess of board i for players[i]
+extern "C" void evaluate_batch(int n, const int *boards, const int *players, int *values) {
+    parallel_for(n, [&](int i) {
+        values[i] = evaluate_chess(players[i], to_board(batch_chess(boards, i)));
+    });
+}
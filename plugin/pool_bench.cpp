@@ -0,0 +1,183 @@
+#include "chess.hpp"
+#include "game_rules.hpp"
+#include "thread_pools.hpp"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(bool csv, const std::string &benchmark, const std::string &pool, const std::string &metric,
+                   double value) {
+    if (csv) {
+        std::cout << benchmark << "," << pool << "," << metric << "," << std::fixed << std::setprecision(3) << value
+                  << std::endl;
+    } else {
+        std::cout << std::left << std::setw(12) << benchmark << std::setw(16) << pool << std::setw(12) << metric
+                  << std::fixed << std::setprecision(3) << value << std::endl;
+    }
+}
+
+static std::uint64_t perft(int player, const board_t &board, int depth) {
+    action_list_t actions;
+    generate_actions(player, board, actions);
+    if (depth == 1) return actions.size();
+    std::uint64_t leaves = 0;
+    for (const auto &action : actions) {
+        board_t next = board;
+        apply_action(next, action);
+        leaves += perft(3 - player, next, depth - 1);
+    }
+    return leaves;
+}
+
+// perft forking at every interior node down to split_depth, halving the action range with join,
+// which needs no allocation however many children a node has
+static std::uint64_t perft_fork(thread_pool::work_stealing_pool &pool, int player, const board_t &board, int depth,
+                                int split_depth);
+
+static std::uint64_t perft_range(thread_pool::work_stealing_pool &pool, int player, const board_t &board,
+                                 const action_t *begin, const action_t *end, int depth, int split_depth) {
+    if (end - begin == 1) {
+        board_t next = board;
+        apply_action(next, *begin);
+        return perft_fork(pool, 3 - player, next, depth - 1, split_depth);
+    }
+    const action_t *middle = begin + (end - begin) / 2;
+    std::uint64_t left = 0, right = 0;
+    pool.join([&] { left = perft_range(pool, player, board, begin, middle, depth, split_depth); },
+              [&] { right = perft_range(pool, player, board, middle, end, depth, split_depth); });
+    return left + right;
+}
+
+static std::uint64_t perft_fork(thread_pool::work_stealing_pool &pool, int player, const board_t &board, int depth,
+                                int split_depth) {
+    if (depth <= split_depth) return perft(player, board, depth);
+    action_list_t actions;
+    generate_actions(player, board, actions);
+    if (actions.size() == 0) return 0;
+    return perft_range(pool, player, board, actions.begin(), actions.end(), depth, split_depth);
+}
+
+// perft splitting at the root only, the finest split a pool without fork-join can wait on
+static std::uint64_t perft_root_split(thread_pool::static_pool &pool, int player, const board_t &board, int depth) {
+    action_list_t actions;
+    generate_actions(player, board, actions);
+    std::vector<std::future<std::uint64_t>> results;
+    for (const auto &action : actions) {
+        results.emplace_back(pool.enqueue([player, board, action, depth]() {
+            board_t next = board;
+            apply_action(next, action);
+            return perft(3 - player, next, depth - 1);
+        }));
+    }
+    std::uint64_t leaves = 0;
+    for (auto &result : results) leaves += result.get();
+    return leaves;
+}
+
+static std::uint64_t fib(int n) {
+    return n < 2 ? n : fib(n - 1) + fib(n - 2);
+}
+
+// a task for every call above the cutoff, the cost of spawn and sync themselves
+static std::uint64_t fib_fork(thread_pool::work_stealing_pool &pool, int n, int cutoff, std::uint64_t &tasks) {
+    if (n <= cutoff) return fib(n);
+    std::uint64_t a = 0, b = 0, tasks_a = 0, tasks_b = 0;
+    pool.join([&] { a = fib_fork(pool, n - 1, cutoff, tasks_a); },
+              [&] { b = fib_fork(pool, n - 2, cutoff, tasks_b); });
+    tasks += tasks_a + tasks_b + 1;
+    return a + b;
+}
+
+int main(int argc, char *argv[]) {
+    std::size_t threads_cnt = std::max(std::thread::hardware_concurrency(), 1u);
+    int tasks_cnt = 200000, perft_depth = 4, fib_n = 32;
+    bool csv = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp("--csv", argv[i]) == 0) {
+            csv = true;
+        } else if (strcmp("--threads", argv[i]) == 0 && i + 1 < argc) {
+            threads_cnt = std::max(std::atoi(argv[++i]), 1);
+        } else if (strcmp("--tasks", argv[i]) == 0 && i + 1 < argc) {
+            tasks_cnt = std::max(std::atoi(argv[++i]), 1);
+        } else if (strcmp("--perft-depth", argv[i]) == 0 && i + 1 < argc) {
+            perft_depth = std::max(std::atoi(argv[++i]), 2);
+        } else if (strcmp("--fib", argv[i]) == 0 && i + 1 < argc) {
+            fib_n = std::max(std::atoi(argv[++i]), 2);
+        } else {
+            std::cout << "usage: " << argv[0] << " [--csv] [--threads n, default=cores] [--tasks n, default=200000]"
+                      << " [--perft-depth n, default=4] [--fib n, default=32]" << std::endl;
+            return -1;
+        }
+    }
+    if (csv) std::cout << "benchmark,pool,metric,value" << std::endl;
+
+    thread_pool::static_pool static_pool(threads_cnt);
+    thread_pool::work_stealing_pool stealing_pool(threads_cnt);
+    bool ok = true;
+
+    // tiny independent tasks, the cost of the queue itself
+    {
+        std::atomic<int> sum{0};
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < tasks_cnt; i++) static_pool.enqueue([&sum]() { sum.fetch_add(1); });
+        static_pool.wait();
+        report(csv, "enqueue", "static_pool", "tasks/s", tasks_cnt / seconds_since(start));
+
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < tasks_cnt; i++) stealing_pool.enqueue([&sum]() { sum.fetch_add(1); });
+        stealing_pool.wait();
+        report(csv, "enqueue", "work_stealing", "tasks/s", tasks_cnt / seconds_since(start));
+        ok = ok && sum == 2 * tasks_cnt;
+    }
+
+    // fork-join from the pool, nested as deep as the recursion goes
+    {
+        auto start = std::chrono::steady_clock::now();
+        const std::uint64_t expected = fib(fib_n);
+        report(csv, "fib", "serial", "seconds", seconds_since(start));
+
+        std::uint64_t value = 0, tasks = 0;
+        start = std::chrono::steady_clock::now();
+        stealing_pool.enqueue([&]() { value = fib_fork(stealing_pool, fib_n, 10, tasks); }).wait();
+        const double elapsed = seconds_since(start);
+        report(csv, "fib", "work_stealing", "seconds", elapsed);
+        report(csv, "fib", "work_stealing", "tasks/s", tasks / elapsed);
+        ok = ok && value == expected;
+    }
+
+    // the split search shape: every interior node of the top plies forks its children
+    {
+        int chess[BOARD_SIZE][BOARD_SIZE];
+        std::memcpy(chess, start_chess.value, sizeof(chess));
+        const board_t board = to_board(chess);
+
+        auto start = std::chrono::steady_clock::now();
+        const std::uint64_t expected = perft(1, board, perft_depth);
+        double elapsed = seconds_since(start);
+        report(csv, "perft", "serial", "nodes/s", expected / elapsed);
+
+        start = std::chrono::steady_clock::now();
+        std::uint64_t leaves = perft_root_split(static_pool, 1, board, perft_depth);
+        elapsed = seconds_since(start);
+        report(csv, "perft", "static_pool", "nodes/s", leaves / elapsed);
+        ok = ok && leaves == expected;
+
+        start = std::chrono::steady_clock::now();
+        leaves = 0;
+        stealing_pool.enqueue([&]() { leaves = perft_fork(stealing_pool, 1, board, perft_depth, 1); }).wait();
+        elapsed = seconds_since(start);
+        report(csv, "perft", "work_stealing", "nodes/s", leaves / elapsed);
+        ok = ok && leaves == expected;
+    }
+
+    report(csv, "all", "-", "match", ok);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,179 @@
+#include "race_solver.hpp"
+#include "chess.hpp"
+#include <algorithm>
+#include <limits>
+
+static constexpr int FOUND = -1;
+static constexpr int ABORTED = -2;
+static constexpr int NOT_FOUND = std::numeric_limits<int>::max();
+
+// cells whose x has the parity of bit 0 of the class and y that of bit 1. a jump covers an even number of
+// cells along a line, so only a step brings a piece into another class.
+static constexpr mask_t make_parity_mask(int parity) {
+    mask_t mask = 0;
+    for (int cell = 0; cell < CELL_CNT; cell++) {
+        auto[x, y] = to_point(cell);
+        if ((x & 1) == (parity & 1) && (y & 1) == (parity >> 1)) mask |= cell_mask(cell);
+    }
+    return mask;
+}
+
+static constexpr mask_t parity_mask[4] = {make_parity_mask(0), make_parity_mask(1), make_parity_mask(2),
+                                          make_parity_mask(3)};
+
+// a step changes x + y by at most one, so no cell further than PIECE_ROWS rows from the corner is next to a finish
+static constexpr mask_t make_near_mask(int player) {
+    mask_t mask = 0;
+    for (int cell = 0; cell < CELL_CNT; cell++) {
+        auto[x, y] = to_point(cell);
+        if (player == 1 ? x + y <= geometry::PIECE_ROWS : x + y >= 2 * (BOARD_SIZE - 1) - geometry::PIECE_ROWS) {
+            mask |= cell_mask(cell);
+        }
+    }
+    return mask;
+}
+
+static constexpr mask_t near_mask[2] = {make_near_mask(1), make_near_mask(2)};
+
+// moves beyond one per piece off its finish cells, for pieces of one kind on the cells of one parity class.
+// the pieces the class holds more than it has finish cells for must leave it with a step, which costs a
+// piece already on a finish cell its first move, and a piece more than a step away its second one.
+static inline int class_surplus_moves(mask_t pieces, mask_t cells, mask_t near) {
+    const int surplus = mask_popcount(pieces) - mask_popcount(cells);
+    if (surplus <= 0) return 0;
+    return std::max(0, surplus - mask_popcount(pieces & ~cells & near));
+}
+
+// every piece off a cell it may finish on moves at least once, and a move moves one piece only
+static inline int finish_lower_bound(int player, const board_t &board) {
+    const mask_t pieces = board.pieces[player - 1];
+    const mask_t special = board.special & pieces;
+    const mask_t special_cells = finish_special_mask[player - 1];
+    const mask_t normal_cells = finish_mask[player - 1] & ~special_cells;
+    int bound = mask_popcount((pieces ^ special) & ~normal_cells) + mask_popcount(special & ~special_cells);
+    for (const mask_t m : parity_mask) {
+        bound += class_surplus_moves((pieces ^ special) & m, normal_cells & m, near_mask[player - 1]);
+        bound += class_surplus_moves(special & m, special_cells & m, near_mask[player - 1]);
+    }
+    return bound;
+}
+
+void race_solver::resize(std::size_t max_nodes) {
+    _max_nodes = max_nodes;
+    // one iteration stores at most max_nodes positions, keep the table at most half full
+    std::size_t cnt = 1;
+    while (cnt < 2 * max_nodes) cnt *= 2;
+    _entries.assign(max_nodes ? cnt : 0, entry_t{});
+    _generation = 0;
+}
+
+bool race_solver::visit(std::uint64_t key, int moves) {
+    const std::size_t mask = _entries.size() - 1;
+    for (std::size_t i = key & mask;; i = (i + 1) & mask) {
+        auto &entry = _entries[i];
+        if (entry.generation != _generation) {
+            entry = {key, static_cast<std::uint16_t>(moves), _generation};
+            return true;
+        }
+        if (entry.key == key) {
+            if (entry.moves <= moves) return false;
+            entry.moves = static_cast<std::uint16_t>(moves);
+            return true;
+        }
+    }
+}
+
+bool race_solver::follow_endgame_db(const board_t &board, int distance) {
+    const std::size_t path_size = _path.size();
+    board_t curr = board;
+    action_list_t actions;
+    for (; distance > 0; distance--) {
+        generate_actions(_player, curr, actions);
+        const auto it = std::find_if(actions.begin(), actions.end(), [&](const action_t &action) {
+            board_t child = curr;
+            apply_action(child, action);
+            int child_distance;
+            return probe_endgame_db(_player, child, child_distance) && child_distance == distance - 1;
+        });
+        if (it == actions.end()) {
+            _path.resize(path_size);
+            return false;
+        }
+        _path.push_back(*it);
+        apply_action(curr, *it);
+    }
+    return true;
+}
+
+int race_solver::dfs(board_t &board, int moves, int bound) {
+    // the table only knows finishes within its region, a shorter one may leave it, so its distance can not prune.
+    // a finish it knows within the bound is a shortest one all the same, every shorter bound failed before.
+    int distance;
+    if (probe_endgame_db(_player, board, distance) && moves + distance <= bound && follow_endgame_db(board, distance)) {
+        return FOUND;
+    }
+    const int f = moves + finish_lower_bound(_player, board);
+    if (f > bound) return f;
+    if (is_finish(_player, board)) return FOUND;
+    if (++_nodes > _max_nodes) return ABORTED;
+    if ((_nodes & 1023u) == 0 && std::chrono::steady_clock::now() >= _deadline) return ABORTED;
+    if (!visit(board.hash, moves)) return NOT_FOUND;
+
+    action_list_t actions;
+    generate_actions(_player, board, actions);
+
+    // actions bringing a piece home first, then the furthest forward, then in generation order
+    const mask_t pieces = board.pieces[_player - 1];
+    const mask_t special = board.special & pieces;
+    const mask_t normal_cells = finish_mask[_player - 1] & ~finish_special_mask[_player - 1];
+    std::pair<int, int> order[MAX_LEGAL_ACTIONS];
+    for (std::size_t i = 0; i < actions.size(); i++) {
+        const auto &a = actions[i];
+        const mask_t cells = (special & cell_mask(to_cell(a.begin))) ? finish_special_mask[_player - 1] : normal_cells;
+        int placed = (int) ((cells & cell_mask(to_cell(a.end))) != 0) - (int) ((cells & cell_mask(to_cell(a.begin))) != 0);
+        int dist = a.begin.x + a.begin.y - a.end.x - a.end.y;
+        if (_player == 2) dist = -dist;
+        order[i] = {-(placed * 64 + dist), (int) i};
+    }
+    std::sort(order, order + actions.size());
+
+    int next_bound = NOT_FOUND;
+    for (std::size_t i = 0; i < actions.size(); i++) {
+        const auto &action = actions[order[i].second];
+        board_t child = board;
+        apply_action(child, action);
+        _path.push_back(action);
+        int t = dfs(child, moves + 1, bound);
+        if (t == FOUND || t == ABORTED) return t;
+        _path.pop_back();
+        next_bound = std::min(next_bound, t);
+    }
+    return next_bound;
+}
+
+bool race_solver::solve(int player, const board_t &board, std::chrono::steady_clock::time_point deadline,
+                        std::vector<action_t> &plan) {
+    _nodes = 0;
+    if (_max_nodes == 0) return false;
+    _player = player;
+    _deadline = deadline;
+
+    // the opponent pieces stay where they are, they may only move further away
+    board_t race = board;
+    for (int bound = finish_lower_bound(player, race); bound <= std::numeric_limits<std::uint16_t>::max();) {
+        // a new generation empties the table
+        if (++_generation == 0) {
+            std::fill(_entries.begin(), _entries.end(), entry_t{});
+            _generation = 1;
+        }
+        _path.clear();
+        int t = dfs(race, 0, bound);
+        if (t == FOUND) {
+            plan = _path;
+            return true;
+        }
+        if (t == ABORTED || t == NOT_FOUND) return false;
+        bound = t;
+    }
+    return false;
+}
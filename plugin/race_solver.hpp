@@ -0,0 +1,58 @@
+#ifndef PLUGIN_RACE_SOLVER_HPP
+#define PLUGIN_RACE_SOLVER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct board_t;
+struct action_t;
+
+// once the two armies have passed each other, the opponent can not hinder any more, and
+// finishing is a shortest path problem over our own pieces. the solver runs IDA* and skips
+// positions reached before with no more moves. its heuristic counts the pieces not on a final
+// cell, one move brings at most one piece home, plus a second move for each piece that has to
+// change the parities of its coordinates on the way and is not a step from the finish, as
+// only a step does that. positions in the endgame table end the search below them when the
+// finish of the table fits in the bound.
+class race_solver {
+private:
+    struct entry_t {
+        std::uint64_t key{0};
+        std::uint16_t moves{0};
+        std::uint16_t generation{0}; // 0 marks an empty entry
+    };
+
+    std::vector<entry_t> _entries; // open addressing, a power-of-two size
+    std::uint16_t _generation{0};
+    std::size_t _max_nodes{0};
+    std::size_t _nodes{0};
+    std::chrono::steady_clock::time_point _deadline;
+    int _player{1};
+    std::vector<action_t> _path;
+
+    // false if the position was reached before within at most moves
+    bool visit(std::uint64_t key, int moves);
+
+    int dfs(board_t &board, int moves, int bound);
+
+    // append the moves of the endgame table from a position distance moves before the finish, false if an
+    // opponent piece outside the region blocks them
+    bool follow_endgame_db(const board_t &board, int distance);
+
+public:
+    explicit race_solver(std::size_t max_nodes = 0) { resize(max_nodes); }
+
+    // nodes searched at most by one solve, 0 disables the solver
+    void resize(std::size_t max_nodes);
+
+    // the shortest finish of player with the opponent pieces kept in place, false if it was not
+    // found within the node budget or before the deadline.
+    bool solve(int player, const board_t &board, std::chrono::steady_clock::time_point deadline,
+               std::vector<action_t> &plan);
+
+    std::size_t nodes() const { return _nodes; }
+};
+
+#endif //PLUGIN_RACE_SOLVER_HPP
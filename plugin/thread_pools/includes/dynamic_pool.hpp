@@ -7,14 +7,15 @@
 #include <cstdint>
 #include <functional>
 #include <future>
-#include <stack>
+#include <chrono>
 #include <condition_variable>
 #include <exception>
+#include <limits>
 #include <unordered_map>
 #include <mutex>
-#include <list>
 #include <queue>
 #include <thread>
+#include <vector>
 #include <algorithm>
 
 #include "util.hpp"
@@ -22,117 +23,256 @@
 namespace thread_pool
 {
 
+// Snapshot of a dynamic_pool, plain data so it can be handed out as is.
+// waits run from enqueue to the start of the task, runs from its start to its end.
+struct dynamic_pool_stats
+{
+    std::uint64_t queue_depth     { 0 }; // tasks waiting for a worker
+    std::uint64_t workers         { 0 };
+    std::uint64_t active_workers  { 0 }; // workers running a task
+    std::uint64_t peak_workers    { 0 };
+    std::uint64_t started_workers { 0 };
+    std::uint64_t retired_workers { 0 }; // left after idling for the idle timeout
+    std::uint64_t completed_tasks { 0 };
+    double        mean_wait_ms    { 0 };
+    double        max_wait_ms     { 0 };
+    double        mean_run_ms     { 0 };
+};
+
+// Elastic pool: starts without workers, starts one whenever a task is queued with no idle worker to take it,
+// up to max_sz, and lets those above max_idle_sz go once they idled for idle_timeout, so bursts get
+// threads quickly and a quiet pool shrinks back without thrashing between two close bursts.
 class dynamic_pool final
 {
 public:
-    dynamic_pool(std::size_t = 2 + std::thread::hardware_concurrency(), std::size_t = no_input);
-    ~dynamic_pool();
+    explicit dynamic_pool(std::size_t = 2 + std::thread::hardware_concurrency(), std::size_t = no_input,
+                          std::chrono::milliseconds idle_timeout = std::chrono::milliseconds(1000));
+    ~dynamic_pool(); // Runs the queued tasks, then joins every worker.
+    dynamic_pool(const dynamic_pool&) = delete;
+    dynamic_pool& operator=(const dynamic_pool&) = delete;
+    // Starts workers up to Sz (at most max_size) first, for a burst known in advance.
     template <std::size_t Sz, typename Func, typename ... Args>
     auto enqueue(Func&& f, Args&& ... args) -> std::future<typename std::result_of<Func(Args...)>::type>;
     template <typename Func, typename ... Args>
     auto enqueue(Func&& f, Args&& ... args) -> std::future<typename std::result_of<Func(Args...)>::type>;
+    void wait(); // Until every enqueued task finished.
+    std::size_t max_size() const noexcept { return m_max_size; }
+    dynamic_pool_stats stats() const;
 #ifdef GANLER_DEBUG
     void unsafe_view()     noexcept {
+        auto s = stats();
         std::cout << "----------------------------------------\n"
-                  << "Queue size:" << m_task_queue.size() << '\n'
-                  << "Thread size:" << m_workers.size()   << '\n'
-                  << "Idle threads:" << m_idle_num << '\n';
+                  << "Queue size:" << s.queue_depth << '\n'
+                  << "Thread size:" << s.workers   << '\n'
+                  << "Idle threads:" << s.workers - s.active_workers << '\n';
     }
 #endif
 private:
     static constexpr std::size_t no_input        = std::numeric_limits<std::size_t>::max();
+    using                        clock_type      = std::chrono::steady_clock;
     using                        task_type       = std::function<void()>;
     using                        thread_index    = std::thread::id;
     using                        thread_map      = std::unordered_map<thread_index, std::thread>;
 
-    const std::size_t            m_max_size;
-    const std::size_t            m_max_idle_size;
-    std::atomic<int>             m_idle_num      { 0 };
-    std::mutex                   m_queue_mu;
-    std::mutex                   m_map_mu;
+    struct queued_task
+    {
+        task_type              task;
+        clock_type::time_point enqueued;
+    };
+
+    const std::size_t               m_max_size;
+    const std::size_t               m_max_idle_size;
+    const std::chrono::milliseconds m_idle_timeout;
+
+    // Everything up to m_map_mu is guarded by m_queue_mu.
+    mutable std::mutex           m_queue_mu;
     std::condition_variable      m_cv;
-    thread_map                   m_workers;
-    std::queue<task_type>        m_task_queue;
+    std::condition_variable      m_wait_cv;
+    std::queue<queued_task>      m_task_queue;
+    std::size_t                  m_worker_num    { 0 }; // started and not leaving, counted from the moment enqueue asks for it
+    std::size_t                  m_idle_num      { 0 }; // of m_worker_num, those not running a task
+    std::size_t                  m_pending       { 0 }; // enqueued and not finished
     bool                         m_shutdown      { false };
+    dynamic_pool_stats           m_stats;               // the counters only, stats() fills in the rest
+    std::uint64_t                m_wait_ns_sum   { 0 };
+    std::uint64_t                m_wait_ns_max   { 0 };
+    std::uint64_t                m_run_ns_sum    { 0 };
+
+    std::mutex                   m_map_mu;
+    thread_map                   m_workers;
+    std::vector<std::thread>     m_retired;             // workers that left, joined by the next make_workers or the destructor
 
     // Helper
-    void make_worker();                          // Called by locked function.
-    void destroy_worker(thread_index);           // Called by locked function.
+    std::size_t reserve_workers(std::size_t target);    // Called by locked function, the count make_workers has to start.
+    void make_workers(std::size_t cnt);
+    void run_worker();
+    void retire_worker(thread_index);
 };
 
 
 // Implementation
     // Init :)
-inline dynamic_pool::dynamic_pool(std::size_t max_sz, std::size_t max_idle_sz)
-: m_max_size(max_sz), m_max_idle_size( max_idle_sz == no_input ? max_sz / 2 : max_idle_sz)
+inline dynamic_pool::dynamic_pool(std::size_t max_sz, std::size_t max_idle_sz, std::chrono::milliseconds idle_timeout)
+: m_max_size(max_sz), m_max_idle_size( max_idle_sz == no_input ? max_sz / 2 : max_idle_sz), m_idle_timeout(idle_timeout)
 {
     if(m_max_idle_size > m_max_size || m_max_size == 0)
         throw std::logic_error("Please make sure: max_idle_sz <= max_size && max_sz > 0\n");
 }
 
-inline void dynamic_pool::destroy_worker(thread_index index)
+inline std::size_t dynamic_pool::reserve_workers(std::size_t target)
 {
-    m_task_queue.emplace([this, index](){
-        if(!m_shutdown)
-        {
-            std::lock_guard<std::mutex> lk(m_map_mu);
-            m_workers[index].join();
-            m_workers.erase(index);
-        }
-    });
+    target = std::min(target, m_max_size);
+    if(m_shutdown || m_worker_num >= target)
+        return 0;
+    const auto cnt = target - m_worker_num;
+    m_worker_num += cnt;
+    m_idle_num   += cnt; // counted idle while they start, so a burst does not ask for more of them
+    m_stats.peak_workers     = std::max<std::uint64_t>(m_stats.peak_workers, m_worker_num);
+    m_stats.started_workers += cnt;
+    return cnt;
+}
+
+inline void dynamic_pool::make_workers(std::size_t cnt)
+{
+    if(cnt == 0)
+        return;
+    std::lock_guard<std::mutex> lk(m_map_mu);
+    // A retired worker only returns after giving up its handle, so these joins are short.
+    for(auto& thread : m_retired)
+        thread.join();
+    m_retired.clear();
+    for(std::size_t i = 0; i < cnt; ++i)
+    {
+        // Holding m_map_mu, the worker cannot retire before its handle is in the map.
+        auto thread = std::thread{[this](){ run_worker(); }};
+        m_workers[thread.get_id()] = std::move(thread);
+    }
+}
+
+inline void dynamic_pool::retire_worker(thread_index index)
+{
+    std::lock_guard<std::mutex> lk(m_map_mu);
+    auto it = m_workers.find(index);
+    if(it == m_workers.end())
+        return; // The destructor took the handle and joins us.
+    m_retired.push_back(std::move(it->second));
+    m_workers.erase(it);
 }
 
-inline void dynamic_pool::make_worker()
+inline void dynamic_pool::run_worker()
 {
-    auto thread = std::thread{[this](){
-        while(true)
+    bool retired = false;
+    std::unique_lock<std::mutex> lock(m_queue_mu);
+    while(true)
+    {
+        if(m_task_queue.empty())
         {
-            std::unique_lock<std::mutex> lock(m_queue_mu);
-            m_cv.wait(lock, [this](){ return m_shutdown or !m_task_queue.empty() or m_idle_num > m_max_idle_size; });
-            if(m_shutdown and m_task_queue.empty()) { return; } // Game over.
-            if(m_idle_num > m_max_idle_size and !m_shutdown)
+            if(m_shutdown)
+                break; // Game over.
+            const bool woken = m_cv.wait_for(lock, m_idle_timeout, [this](){ return m_shutdown or !m_task_queue.empty(); });
+            if(!woken and m_worker_num > m_max_idle_size)
             {// Cut the idle threads.
-                destroy_worker(std::this_thread::get_id());
-                --m_idle_num;
-                return;
+                retired = true;
+                ++m_stats.retired_workers;
+                break;
             }
-            --m_idle_num;
-            auto task = std::move(m_task_queue.front());
-            m_task_queue.pop();
-            lock.unlock(); // LOCK IS OVER.
-            task();
-            ++m_idle_num;  // ATOMIC
-        }}};
-    ++m_idle_num;
-    m_workers[thread.get_id()] = std::move(thread);
+            continue;
+        }
+        auto item = std::move(m_task_queue.front());
+        m_task_queue.pop();
+        --m_idle_num;
+        const auto start = clock_type::now();
+        lock.unlock(); // LOCK IS OVER.
+        item.task();
+        const auto end = clock_type::now();
+        lock.lock();
+        ++m_idle_num;
+        const auto wait_ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(start - item.enqueued).count());
+        m_wait_ns_sum += wait_ns;
+        m_wait_ns_max  = std::max(m_wait_ns_max, wait_ns);
+        m_run_ns_sum  += static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        ++m_stats.completed_tasks;
+        if(--m_pending == 0)
+            m_wait_cv.notify_all();
+    }
+    --m_idle_num;
+    --m_worker_num;
+    lock.unlock();
+    if(retired)
+        retire_worker(std::this_thread::get_id());
+}
+
+inline void dynamic_pool::wait()
+{
+    std::unique_lock<std::mutex> lock(m_queue_mu);
+    m_wait_cv.wait(lock, [this](){ return m_pending == 0; });
+}
+
+inline dynamic_pool_stats dynamic_pool::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_queue_mu);
+    auto s = m_stats;
+    s.queue_depth    = m_task_queue.size();
+    s.workers        = m_worker_num;
+    s.active_workers = m_worker_num - m_idle_num;
+    if(s.completed_tasks != 0)
+    {
+        s.mean_wait_ms = m_wait_ns_sum * 1e-6 / s.completed_tasks;
+        s.mean_run_ms  = m_run_ns_sum  * 1e-6 / s.completed_tasks;
+    }
+    s.max_wait_ms = m_wait_ns_max * 1e-6;
+    return s;
 }
 
 inline dynamic_pool::~dynamic_pool()
 {
-    m_shutdown = true;
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mu);
+        m_shutdown = true;
+    }
     m_cv.notify_all();
-    std::for_each(m_workers.begin(), m_workers.end(), [](thread_map::value_type& x){ (x.second).join(); });
+    // Join outside m_map_mu, a worker that is retiring right now needs it to find out we own its handle.
+    thread_map               workers;
+    std::vector<std::thread> retired;
+    {
+        std::lock_guard<std::mutex> lk(m_map_mu);
+        workers.swap(m_workers);
+        retired.swap(m_retired);
+    }
+    std::for_each(workers.begin(), workers.end(), [](thread_map::value_type& x){ (x.second).join(); });
+    std::for_each(retired.begin(), retired.end(), [](std::thread& x){ x.join(); });
 }
 
 template <std::size_t Sz, typename Func, typename ... Args>
 auto dynamic_pool::enqueue(Func &&f, Args &&... args) -> std::future<typename std::result_of<Func(Args...)>::type>
 {
-    using return_type = typename std::result_of<Func(Args...)>::type;
-    if(m_idle_num == 0)
-        for (int i = 0; i < std::min(Sz, m_max_idle_size); ++i)
-            make_worker();
-    MAKE_TASK()
+    std::size_t start_cnt;
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mu);
+        start_cnt = reserve_workers(Sz);
+    }
+    make_workers(start_cnt);
+    return enqueue(std::forward<Func>(f), std::forward<Args>(args)...);
 }
 
 template <typename Func, typename ... Args>
 auto dynamic_pool::enqueue(Func &&f, Args &&... args) -> std::future<typename std::result_of<Func(Args...)>::type>
 {
     using return_type = typename std::result_of<Func(Args...)>::type;
-    MAKE_TASK(
-            auto sz = std::min({m_task_queue.size(), m_max_idle_size, m_max_size - m_workers.size()});
-            if(m_idle_num == 0 and m_workers.size() < m_max_size)
-                     for (int i = 0; i < sz; ++i)
-                             make_worker();)
+    std::packaged_task<return_type()>* task = nullptr; // Why raw pointer? See comments in static_pool.hpp's enqueue().
+    try_allocate(task, std::forward<Func>(f), std::forward<Args>(args)...);
+    auto result = task->get_future();
+    std::size_t start_cnt;
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mu);
+        m_task_queue.push(queued_task{[task](){ (*task)(); delete task; }, clock_type::now()});
+        ++m_pending;
+        // One more worker while the queue outgrows the idle ones.
+        start_cnt = m_idle_num < m_task_queue.size() ? reserve_workers(m_worker_num + 1) : 0;
+    }
+    make_workers(start_cnt);
+    m_cv.notify_one();
+    return result;
 }
 
-}
\ No newline at end of file
+}
@@ -5,9 +5,10 @@
 
 #include <dynamic_pool.hpp>
 #include <static_pool.hpp>
+#include <work_stealing_pool.hpp>
 
 /*
  * For all kinds of pools:
  * - void enqueue();
- * - wait(); // TODO: Dynamic Pool's wait() impl.
+ * - wait();
  */
\ No newline at end of file
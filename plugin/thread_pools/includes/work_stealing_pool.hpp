@@ -0,0 +1,526 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace thread_pool {
+
+class work_stealing_pool;
+
+// A fork-join task. It lives in the frame that spawns it, so spawning allocates nothing,
+// and the frame must sync it before it goes out of scope.
+class ws_task {
+public:
+    ws_task(const ws_task &) = delete;
+
+    ws_task &operator=(const ws_task &) = delete;
+
+    bool done() const { return m_done.load(std::memory_order_acquire); }
+
+protected:
+    using run_type = void (*)(ws_task *);
+
+    explicit ws_task(run_type run) : m_run(run) {}
+
+    ~ws_task() = default;
+
+    // for closures run by the pool: store the exception for sync, then publish the task as done.
+    // the spawning frame may free the task as soon as it is done, so this must come last.
+    template<typename Func>
+    void run_and_finish(Func &func) {
+        try {
+            func();
+        } catch (...) {
+            m_error = std::current_exception();
+        }
+        m_done.store(true, std::memory_order_release);
+    }
+
+private:
+    friend class work_stealing_pool;
+
+    run_type m_run;
+    std::atomic<bool> m_done{false};
+    std::exception_ptr m_error;
+};
+
+template<typename Func>
+class ws_closure final : public ws_task {
+public:
+    explicit ws_closure(Func func) : ws_task(&invoke), m_func(std::move(func)) {}
+
+private:
+    static void invoke(ws_task *task) {
+        auto *self = static_cast<ws_closure *>(task);
+        self->run_and_finish(self->m_func);
+    }
+
+    Func m_func;
+};
+
+// auto task = make_task([&] { ... }); pool.spawn(task); ...; pool.sync(task);
+template<typename Func>
+ws_closure<typename std::decay<Func>::type> make_task(Func &&func) {
+    return ws_closure<typename std::decay<Func>::type>(std::forward<Func>(func));
+}
+
+// Chase-Lev deque of task pointers (Le, Pop, Cohen, Zappa Nardelli, PPoPP 2013).
+// the owner pushes and pops at the bottom, thieves take from the top.
+// rings replaced by a grow are kept until the deque dies, a thief may still read them.
+class ws_deque final {
+public:
+    explicit ws_deque(std::size_t capacity = 256) : m_ring(new ring(capacity)) {
+        m_rings.emplace_back(m_ring.load(std::memory_order_relaxed));
+    }
+
+    ws_deque(const ws_deque &) = delete;
+
+    ws_deque &operator=(const ws_deque &) = delete;
+
+    void push(ws_task *task) { // owner only
+        const std::int64_t b = m_bottom.load(std::memory_order_relaxed);
+        const std::int64_t t = m_top.load(std::memory_order_acquire);
+        ring *r = m_ring.load(std::memory_order_relaxed);
+        if (b - t > static_cast<std::int64_t>(r->capacity) - 1) r = grow(r, t, b);
+        r->put(b, task);
+        m_bottom.store(b + 1, std::memory_order_release); // publishes the task to the thieves
+    }
+
+    ws_task *pop() { // owner only
+        const std::int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+        ring *r = m_ring.load(std::memory_order_relaxed);
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t t = m_top.load(std::memory_order_relaxed);
+        ws_task *task = nullptr;
+        if (t <= b) {
+            task = r->get(b);
+            if (t == b) {
+                // the last task, race the thieves for it
+                if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    task = nullptr;
+                m_bottom.store(b + 1, std::memory_order_relaxed);
+            }
+        } else {
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return task;
+    }
+
+    ws_task *steal() {
+        std::int64_t t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const std::int64_t b = m_bottom.load(std::memory_order_acquire);
+        if (t >= b) return nullptr;
+        ws_task *task = m_ring.load(std::memory_order_acquire)->get(t);
+        if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return nullptr;
+        return task;
+    }
+
+    bool empty() const {
+        return m_top.load(std::memory_order_acquire) >= m_bottom.load(std::memory_order_acquire);
+    }
+
+private:
+    struct ring {
+        const std::size_t capacity; // a power of two
+        std::unique_ptr<std::atomic<ws_task *>[]> slots;
+
+        explicit ring(std::size_t cap) : capacity(cap), slots(new std::atomic<ws_task *>[cap]) {}
+
+        void put(std::int64_t i, ws_task *task) {
+            slots[static_cast<std::size_t>(i) & (capacity - 1)].store(task, std::memory_order_relaxed);
+        }
+
+        ws_task *get(std::int64_t i) const {
+            return slots[static_cast<std::size_t>(i) & (capacity - 1)].load(std::memory_order_relaxed);
+        }
+    };
+
+    ring *grow(ring *old, std::int64_t t, std::int64_t b) {
+        auto *r = new ring(old->capacity * 2);
+        for (std::int64_t i = t; i < b; ++i) r->put(i, old->get(i));
+        m_rings.emplace_back(r);
+        m_ring.store(r, std::memory_order_release);
+        return r;
+    }
+
+    alignas(64) std::atomic<std::int64_t> m_top{0};
+    alignas(64) std::atomic<std::int64_t> m_bottom{0};
+    std::atomic<ring *> m_ring;
+    std::vector<std::unique_ptr<ring>> m_rings; // owner only
+};
+
+// Work-stealing pool. Every worker owns a deque: spawn pushes to the deque of the calling worker,
+// idle workers steal from the others, and sync runs the task itself if nobody took it, or runs
+// other spawned tasks until it is done, so fork-join calls nest to any depth without blocking a worker.
+// a sync with nothing left to run yields for a while, then sleeps until a task finishes or is spawned.
+// enqueue keeps the interface of static_pool for long tasks with a future. those go through one shared
+// queue that only idle workers take from, so a sync never ends up running one of them.
+class work_stealing_pool final {
+public:
+    const std::size_t size{0};
+
+    explicit work_stealing_pool(std::size_t sz = std::thread::hardware_concurrency() + 2);
+
+    ~work_stealing_pool() { shutdown(); }
+
+    work_stealing_pool(const work_stealing_pool &) = delete;
+
+    work_stealing_pool &operator=(const work_stealing_pool &) = delete;
+
+    template<typename Func, typename... Args>
+    auto enqueue(Func &&f, Args &&... args) -> std::future<typename std::result_of<Func(Args...)>::type>;
+
+    // off the pool the task goes to the shared queue
+    void spawn(ws_task &task);
+
+    // wait for a spawned task, rethrowing its exception
+    void sync(ws_task &task);
+
+    // run a and b in parallel, b may be stolen while this thread runs a
+    template<typename FuncA, typename FuncB>
+    void join(FuncA &&a, FuncB &&b);
+
+    // wait for every enqueued task
+    void wait();
+
+    // finish the queued tasks and join the workers, later calls do nothing
+    void shutdown();
+
+    // whether the calling thread is a worker of this pool
+    bool on_worker() const { return current().pool == this; }
+
+private:
+    struct worker {
+        ws_deque deque;
+        std::uint32_t rng;
+        std::thread thread;
+    };
+
+    struct context {
+        const work_stealing_pool *pool{nullptr};
+        worker *self{nullptr};
+    };
+
+    static context &current() {
+        thread_local context ctx;
+        return ctx;
+    }
+
+    std::vector<std::unique_ptr<worker>> m_workers;
+
+    std::mutex m_queue_mu;
+    std::deque<ws_task *> m_queue; // tasks from enqueue and from spawns off the pool
+    std::atomic<std::size_t> m_queue_size{0};
+
+    // sleeping workers wait for the epoch to move, see sleep()
+    std::mutex m_sleep_mu;
+    std::condition_variable m_sleep_cv;
+    std::atomic<std::uint64_t> m_epoch{0};
+    std::atomic<int> m_sleeping{0};
+    bool m_stop{false}; // guarded by m_sleep_mu
+
+    std::mutex m_wait_mu;
+    std::condition_variable m_wait_cv;
+    std::atomic<std::size_t> m_pending{0}; // enqueued tasks not yet finished
+
+    // syncs out of work wait for their task or for the epoch to move, see wait_sync()
+    static constexpr int SYNC_SPINS = 64; // yields before a sync sleeps, a split task tends to end soon
+    std::mutex m_sync_mu;
+    std::condition_variable m_sync_cv;
+    std::atomic<std::uint64_t> m_sync_epoch{0};
+    std::atomic<int> m_syncing{0};
+
+    bool m_joined{false};
+
+    void run_worker(worker &self);
+
+    // the task may be gone once it ran, only the pool is touched after
+    void run(ws_task *task) {
+        task->m_run(task);
+        wake_syncing();
+    }
+
+    ws_task *steal_from_others(worker &self);
+
+    ws_task *take_queued();
+
+    void push_queued(ws_task *task);
+
+    void finish_enqueued();
+
+    bool has_spawned() const;
+
+    bool has_work() const;
+
+    void wake_one();
+
+    void sleep(std::uint64_t epoch);
+
+    void wake_syncing();
+
+    void wait_sync(const ws_task &task, bool steals);
+
+    static std::uint32_t next_random(std::uint32_t &state) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+};
+
+
+// Implementation:
+inline work_stealing_pool::work_stealing_pool(std::size_t sz) : size(sz ? sz : 1) {
+    for (std::size_t i = 0; i < size; ++i) {
+        m_workers.emplace_back(new worker());
+        m_workers.back()->rng = static_cast<std::uint32_t>(2654435761u * (i + 1));
+    }
+    // the deques exist before any worker may steal from them
+    for (auto &w : m_workers) {
+        worker *self = w.get();
+        self->thread = std::thread([this, self]() { run_worker(*self); });
+    }
+}
+
+template<typename Func, typename... Args>
+auto work_stealing_pool::enqueue(Func &&f, Args &&... args)
+-> std::future<typename std::result_of<Func(Args...)>::type> {
+    using return_type = typename std::result_of<Func(Args...)>::type;
+
+    // owns itself, freed once it ran
+    struct queued_task final : ws_task {
+        work_stealing_pool *pool;
+        std::packaged_task<return_type()> job;
+
+        queued_task(work_stealing_pool *p, std::packaged_task<return_type()> &&j)
+                : ws_task(&invoke), pool(p), job(std::move(j)) {}
+
+        static void invoke(ws_task *task) {
+            auto *self = static_cast<queued_task *>(task);
+            work_stealing_pool *pool = self->pool;
+            self->job(); // a packaged_task keeps the exception in its future
+            delete self;
+            pool->finish_enqueued();
+        }
+    };
+
+    auto *task = new queued_task(this, std::packaged_task<return_type()>(
+            std::bind(std::forward<Func>(f), std::forward<Args>(args)...)));
+    auto result = task->job.get_future();
+    m_pending.fetch_add(1, std::memory_order_relaxed);
+    push_queued(task);
+    return result;
+}
+
+inline void work_stealing_pool::spawn(ws_task &task) {
+    context &ctx = current();
+    if (ctx.pool != this) {
+        push_queued(&task);
+        return;
+    }
+    ctx.self->deque.push(&task);
+    wake_one();
+    wake_syncing();
+}
+
+inline void work_stealing_pool::sync(ws_task &task) {
+    context &ctx = current();
+    if (ctx.pool == this) {
+        worker &self = *ctx.self;
+        for (int spins = 0; !task.done();) {
+            // our own younger spawns first, then whatever the thieves of our task left for others
+            ws_task *other = self.deque.pop();
+            if (!other) other = steal_from_others(self);
+            if (other) {
+                run(other);
+                spins = 0;
+            } else if (++spins < SYNC_SPINS) {
+                std::this_thread::yield();
+            } else {
+                wait_sync(task, true);
+                spins = 0;
+            }
+        }
+    } else {
+        // take it back if no worker got to it yet
+        bool taken = false;
+        {
+            std::lock_guard<std::mutex> lock(m_queue_mu);
+            for (auto it = m_queue.begin(); it != m_queue.end(); ++it) {
+                if (*it != &task) continue;
+                m_queue.erase(it);
+                m_queue_size.fetch_sub(1, std::memory_order_relaxed);
+                taken = true;
+                break;
+            }
+        }
+        if (taken) run(&task);
+        for (int spins = 0; !task.done(); spins++) {
+            if (spins < SYNC_SPINS) std::this_thread::yield();
+            else wait_sync(task, false);
+        }
+    }
+    if (task.m_error) std::rethrow_exception(task.m_error);
+}
+
+template<typename FuncA, typename FuncB>
+void work_stealing_pool::join(FuncA &&a, FuncB &&b) {
+    auto task_b = make_task(std::forward<FuncB>(b));
+    spawn(task_b);
+    try {
+        a();
+    } catch (...) {
+        // b points into this frame, it has to finish before the exception leaves
+        try { sync(task_b); } catch (...) {}
+        throw;
+    }
+    sync(task_b);
+}
+
+inline void work_stealing_pool::wait() {
+    std::unique_lock<std::mutex> lock(m_wait_mu);
+    m_wait_cv.wait(lock, [this] { return m_pending.load() == 0; });
+}
+
+inline void work_stealing_pool::shutdown() {
+    if (m_joined) return;
+    {
+        std::lock_guard<std::mutex> lock(m_sleep_mu);
+        m_stop = true;
+        m_epoch.fetch_add(1);
+    }
+    m_sleep_cv.notify_all();
+    for (auto &w : m_workers) w->thread.join();
+    m_joined = true;
+}
+
+inline void work_stealing_pool::run_worker(worker &self) {
+    current() = context{this, &self};
+    while (true) {
+        const std::uint64_t epoch = m_epoch.load();
+        ws_task *task = self.deque.pop();
+        if (!task) task = steal_from_others(self);
+        if (!task) task = take_queued();
+        if (task) {
+            run(task);
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_sleep_mu);
+            if (m_stop) break;
+        }
+        sleep(epoch);
+    }
+    current() = context{};
+}
+
+inline ws_task *work_stealing_pool::steal_from_others(worker &self) {
+    const std::size_t n = m_workers.size();
+    if (n < 2) return nullptr;
+    const std::size_t start = next_random(self.rng) % n;
+    for (std::size_t i = 0; i < n; ++i) {
+        worker &victim = *m_workers[(start + i) % n];
+        if (&victim == &self) continue;
+        if (ws_task *task = victim.deque.steal()) return task;
+    }
+    return nullptr;
+}
+
+inline ws_task *work_stealing_pool::take_queued() {
+    if (m_queue_size.load(std::memory_order_acquire) == 0) return nullptr;
+    std::lock_guard<std::mutex> lock(m_queue_mu);
+    if (m_queue.empty()) return nullptr;
+    ws_task *task = m_queue.front();
+    m_queue.pop_front();
+    m_queue_size.fetch_sub(1, std::memory_order_relaxed);
+    return task;
+}
+
+inline void work_stealing_pool::push_queued(ws_task *task) {
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mu);
+        m_queue.push_back(task);
+        m_queue_size.fetch_add(1, std::memory_order_release);
+    }
+    wake_one();
+}
+
+inline void work_stealing_pool::finish_enqueued() {
+    if (m_pending.fetch_sub(1) != 1) return;
+    std::lock_guard<std::mutex> lock(m_wait_mu);
+    m_wait_cv.notify_all();
+}
+
+inline bool work_stealing_pool::has_spawned() const {
+    for (const auto &w : m_workers) {
+        if (!w->deque.empty()) return true;
+    }
+    return false;
+}
+
+inline bool work_stealing_pool::has_work() const {
+    return m_queue_size.load(std::memory_order_seq_cst) != 0 || has_spawned();
+}
+
+// a pusher publishes its task before it reads m_sleeping, a sleeper counts itself before it looks for
+// work, both with seq_cst: either the sleeper sees the task, or the pusher sees the sleeper and moves
+// the epoch the sleeper waits on.
+inline void work_stealing_pool::wake_one() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_sleeping.load(std::memory_order_seq_cst) == 0) return;
+    {
+        std::lock_guard<std::mutex> lock(m_sleep_mu);
+        m_epoch.fetch_add(1);
+    }
+    m_sleep_cv.notify_one();
+}
+
+inline void work_stealing_pool::sleep(std::uint64_t epoch) {
+    m_sleeping.fetch_add(1, std::memory_order_seq_cst);
+    if (!has_work()) {
+        std::unique_lock<std::mutex> lock(m_sleep_mu);
+        m_sleep_cv.wait(lock, [&] { return m_stop || m_epoch.load() != epoch; });
+    }
+    m_sleeping.fetch_sub(1, std::memory_order_seq_cst);
+}
+
+// the same handshake as wake_one and sleep, with finished tasks and spawns in place of pushed work.
+// every syncing thread wakes, they are few, and each goes back to sleep if its task is still running.
+inline void work_stealing_pool::wake_syncing() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_syncing.load(std::memory_order_seq_cst) == 0) return;
+    {
+        std::lock_guard<std::mutex> lock(m_sync_mu);
+        m_sync_epoch.fetch_add(1);
+    }
+    m_sync_cv.notify_all();
+}
+
+// a worker also wakes for a spawn it may steal, a thread off the pool only for its task
+inline void work_stealing_pool::wait_sync(const ws_task &task, bool steals) {
+    const std::uint64_t epoch = m_sync_epoch.load();
+    m_syncing.fetch_add(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!task.done() && !(steals && has_spawned())) {
+        std::unique_lock<std::mutex> lock(m_sync_mu);
+        m_sync_cv.wait(lock, [&] { return task.done() || (steals && m_sync_epoch.load() != epoch); });
+    }
+    m_syncing.fetch_sub(1, std::memory_order_seq_cst);
+}
+
+} // namespace thread_pool
@@ -0,0 +1,100 @@
+#include "transposition_table.hpp"
+#include <limits>
+
+// data layout: value[0:32] depth[32:40] bound[40:42] begin[42:49] end[49:56] generation[56:64]
+static constexpr std::uint64_t NO_MOVE = 0x7f;
+
+static inline std::uint64_t pack(const tt_entry_t &entry, std::uint8_t generation) {
+    std::uint64_t begin = entry.move_begin < 0 ? NO_MOVE : entry.move_begin;
+    std::uint64_t end = entry.move_end < 0 ? NO_MOVE : entry.move_end;
+    return static_cast<std::uint32_t>(entry.value) |
+           static_cast<std::uint64_t>(static_cast<std::uint8_t>(entry.depth)) << 32 |
+           static_cast<std::uint64_t>(entry.bound) << 40 |
+           begin << 42 | end << 49 |
+           static_cast<std::uint64_t>(generation) << 56;
+}
+
+static inline tt_entry_t unpack(std::uint64_t data) {
+    tt_entry_t entry;
+    entry.value = static_cast<std::int32_t>(data & 0xffffffff);
+    entry.depth = static_cast<int>((data >> 32) & 0xff);
+    entry.bound = static_cast<bound_t>((data >> 40) & 0x3);
+    std::uint64_t begin = (data >> 42) & NO_MOVE, end = (data >> 49) & NO_MOVE;
+    entry.move_begin = begin == NO_MOVE ? -1 : static_cast<int>(begin);
+    entry.move_end = end == NO_MOVE ? -1 : static_cast<int>(end);
+    return entry;
+}
+
+static inline std::uint8_t generation_of(std::uint64_t data) {
+    return static_cast<std::uint8_t>(data >> 56);
+}
+
+void transposition_table::resize(std::size_t megabytes) {
+    std::size_t cnt = 0;
+    if (megabytes > 0) {
+        cnt = 1;
+        while (cnt * 2 * sizeof(bucket_t) <= megabytes * 1024 * 1024) cnt *= 2;
+    }
+    _buckets.reset(cnt ? new bucket_t[cnt] : nullptr);
+    _bucket_cnt = cnt;
+    _generation = 0;
+}
+
+void transposition_table::clear() {
+    for (std::size_t i = 0; i < _bucket_cnt; i++) {
+        for (auto &slot : _buckets[i].slots) {
+            slot.check.store(0, std::memory_order_relaxed);
+            slot.data.store(0, std::memory_order_relaxed);
+        }
+    }
+    _generation = 0;
+}
+
+bool transposition_table::probe(std::uint64_t key, tt_entry_t &entry) const {
+    if (_bucket_cnt == 0) return false;
+    for (const auto &slot : bucket(key).slots) {
+        std::uint64_t data = slot.data.load(std::memory_order_relaxed);
+        std::uint64_t check = slot.check.load(std::memory_order_relaxed);
+        if (data != 0 && (check ^ data) == key) {
+            entry = unpack(data);
+            return true;
+        }
+    }
+    return false;
+}
+
+void transposition_table::store(std::uint64_t key, const tt_entry_t &entry) {
+    if (_bucket_cnt == 0) return;
+    slot_t *victim = nullptr;
+    int victim_score = std::numeric_limits<int>::max();
+    for (auto &slot : bucket(key).slots) {
+        std::uint64_t data = slot.data.load(std::memory_order_relaxed);
+        std::uint64_t check = slot.check.load(std::memory_order_relaxed);
+        if (data != 0 && (check ^ data) == key) {
+            // a deeper search of the position knows more than a bound of a shallower one, keep it for this search
+            const tt_entry_t existing = unpack(data);
+            if (existing.depth > entry.depth && entry.bound != bound_t::exact) {
+                data = pack(existing, _generation);
+                slot.data.store(data, std::memory_order_relaxed);
+                slot.check.store(key ^ data, std::memory_order_relaxed);
+                return;
+            }
+            victim = &slot;
+            break;
+        }
+        if (data == 0) {
+            victim = &slot;
+            break;
+        }
+        // replace shallow entries first, entries of old searches before anything else
+        int age = static_cast<std::uint8_t>(_generation - generation_of(data));
+        int score = unpack(data).depth - 8 * age;
+        if (score < victim_score) {
+            victim_score = score;
+            victim = &slot;
+        }
+    }
+    std::uint64_t data = pack(entry, _generation);
+    victim->data.store(data, std::memory_order_relaxed);
+    victim->check.store(key ^ data, std::memory_order_relaxed);
+}
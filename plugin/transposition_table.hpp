@@ -0,0 +1,60 @@
+#ifndef PLUGIN_TRANSPOSITION_TABLE_HPP
+#define PLUGIN_TRANSPOSITION_TABLE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+enum class bound_t : std::uint8_t {
+    none = 0, exact, lower, upper
+};
+
+struct tt_entry_t {
+    int value{0};
+    int depth{0};
+    bound_t bound{bound_t::none};
+    int move_begin{-1}, move_end{-1}; // cells of the best move, -1 if there is no move
+};
+
+// fixed-size bucketed transposition table.
+// every slot keeps key ^ data next to data, so a probe racing with a store
+// sees a mismatched key instead of a torn entry, and no lock is needed.
+class transposition_table {
+private:
+    static constexpr std::size_t SLOTS_PER_BUCKET = 4;
+
+    struct slot_t {
+        std::atomic<std::uint64_t> check{0};
+        std::atomic<std::uint64_t> data{0};
+    };
+
+    struct alignas(64) bucket_t {
+        slot_t slots[SLOTS_PER_BUCKET];
+    };
+
+    std::unique_ptr<bucket_t[]> _buckets;
+    std::size_t _bucket_cnt{0};
+    std::uint8_t _generation{0};
+
+    bucket_t &bucket(std::uint64_t key) const { return _buckets[key & (_bucket_cnt - 1)]; }
+
+public:
+    explicit transposition_table(std::size_t megabytes = 0) { resize(megabytes); }
+
+    // reallocate to the largest power-of-two bucket count that fits, 0 disables the table.
+    void resize(std::size_t megabytes);
+
+    void clear();
+
+    // entries of older searches become preferred victims
+    void new_search() { _generation++; }
+
+    bool probe(std::uint64_t key, tt_entry_t &entry) const;
+
+    void store(std::uint64_t key, const tt_entry_t &entry);
+
+    std::size_t size_in_bytes() const { return _bucket_cnt * sizeof(bucket_t); }
+};
+
+#endif //PLUGIN_TRANSPOSITION_TABLE_HPP
@@ -0,0 +1,388 @@
+#include "chess.hpp"
+#include "game_rules.hpp"
+#include "evaluation.hpp"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+
+// positions file: a header followed by fixed size records
+static constexpr char POSITIONS_MAGIC[8] = {'C', 'H', 'K', 'P', 'O', 'S', 0, 0};
+static constexpr std::uint32_t POSITIONS_VERSION = 1;
+static constexpr std::uint8_t SPECIAL_BIT = 0x80;
+
+struct positions_header_t {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t record_size;
+    std::uint16_t board_size; // positions of one board only fit the weights of that board
+    std::uint16_t piece_rows;
+    std::uint32_t reserved;
+    std::uint64_t record_cnt;
+};
+
+struct position_record_t {
+    std::uint8_t cells[2][PIECE_CNT]; // cells of the pieces of player 1 and 2, SPECIAL_BIT marks a special piece
+    std::int8_t result; // 1 if player 1 won the game, -1 if player 2 won, 0 for a draw
+    std::uint8_t step;  // step of the game after which the position was seen
+};
+static_assert(sizeof(position_record_t) == 2 * PIECE_CNT + 2, "position records must stay packed");
+
+// weights of score7 followed by score3, as in eval_weights.hpp
+static constexpr int WEIGHT_TABLE_SIZE = WEIGHT_SIZE * WEIGHT_SIZE;
+static constexpr int WEIGHT_CNT = 2 * WEIGHT_TABLE_SIZE;
+static_assert(WEIGHT_CNT <= 256, "samples keep weight indices in bytes");
+
+static position_record_t to_record(const board_t &board, int step) {
+    position_record_t record{};
+    for (int player = 0; player < 2; player++) {
+        int cnt = 0;
+        for (int cell = 0; cell < CELL_CNT && cnt < PIECE_CNT; cell++) {
+            const mask_t m = cell_mask(cell);
+            if (!(board.pieces[player] & m)) continue;
+            record.cells[player][cnt++] = static_cast<std::uint8_t>(cell | (board.special & m ? SPECIAL_BIT : 0));
+        }
+    }
+    record.step = static_cast<std::uint8_t>(step);
+    return record;
+}
+
+static bool write_positions(const std::string &path, const std::vector<position_record_t> &records) {
+    std::ofstream out(path, std::ios::binary);
+    positions_header_t header{};
+    std::memcpy(header.magic, POSITIONS_MAGIC, sizeof(header.magic));
+    header.version = POSITIONS_VERSION;
+    header.record_size = sizeof(position_record_t);
+    header.board_size = BOARD_SIZE;
+    header.piece_rows = geometry::PIECE_ROWS;
+    header.record_cnt = records.size();
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(position_record_t));
+    return out.good();
+}
+
+static bool read_positions(const std::string &path, std::vector<position_record_t> &records) {
+    std::ifstream in(path, std::ios::binary);
+    positions_header_t header{};
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof(header))) return false;
+    if (std::memcmp(header.magic, POSITIONS_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != POSITIONS_VERSION || header.record_size != sizeof(position_record_t) ||
+        header.board_size != BOARD_SIZE || header.piece_rows != geometry::PIECE_ROWS) {
+        return false;
+    }
+    records.resize(header.record_cnt);
+    return (bool) in.read(reinterpret_cast<char *>(records.data()), records.size() * sizeof(position_record_t));
+}
+
+// split [0, n) into one chunk per thread
+template<class F>
+static void parallel_chunks(std::size_t n, unsigned threads_cnt, F &&f) {
+    std::vector<std::thread> threads;
+    const std::size_t chunk = (n + threads_cnt - 1) / threads_cnt;
+    for (unsigned t = 0; t < threads_cnt; t++) {
+        const std::size_t begin = std::min(n, t * chunk), end = std::min(n, begin + chunk);
+        threads.emplace_back([&f, t, begin, end]() { f(t, begin, end); });
+    }
+    for (auto &thread : threads) thread.join();
+}
+
+struct gen_config_t {
+    std::string out{"positions.bin"};
+    int games{1000};
+    int depth{2};
+    int opening_plies{8};
+    unsigned threads_cnt{std::max(std::thread::hardware_concurrency(), 1u)};
+    unsigned seed{std::random_device{}()};
+};
+
+// self-play of one fixed depth agent against itself from a random opening.
+// every position after the opening is recorded, the final position is left out since it is decided.
+static void play_game(const gen_config_t &config, int game, std::vector<position_record_t> &records) {
+    MinMaxAgent agents[2] = {MinMaxAgent(1), MinMaxAgent(2)};
+    for (auto &agent : agents) {
+        agent.max_search_depth = config.depth;
+        agent.max_search_depth_without_opponent = config.depth;
+        agent.max_search_actions_cnt = 32;
+        agent.set_tt_size(4);
+    }
+    std::minstd_rand opening_rng(config.seed + game);
+
+    int chess[BOARD_SIZE][BOARD_SIZE];
+    std::memcpy(chess, start_chess.value, sizeof(chess));
+    board_t board = to_board(chess);
+    const std::size_t first = records.size();
+    int winner = 0, player = 1;
+    for (int step = 1; step <= MAX_STEPS; step++) {
+        action_t action;
+        if (step <= config.opening_plies) {
+            action_list_t actions;
+            generate_actions(player, board, actions);
+            if (actions.size() == 0) break;
+            action = actions[std::uniform_int_distribution<std::size_t>(0, actions.size() - 1)(opening_rng)];
+        } else {
+            action = std::get<1>(agents[player - 1].run(board));
+        }
+        apply_action(board, action);
+        if ((winner = python_winner(board, step))) break;
+        if (step > config.opening_plies) records.push_back(to_record(board, step));
+        player = 3 - player;
+    }
+    for (std::size_t i = first; i < records.size(); i++) {
+        records[i].result = static_cast<std::int8_t>(winner == 1 ? 1 : winner == 2 ? -1 : 0);
+    }
+}
+
+static int run_gen(const gen_config_t &config) {
+    std::vector<position_record_t> records;
+    std::mutex records_mtx;
+    std::atomic<int> next_game{0}, wins[3] = {{0}, {0}, {0}};
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < std::min<unsigned>(config.threads_cnt, config.games); t++) {
+        threads.emplace_back([&]() {
+            for (int game; (game = next_game.fetch_add(1)) < config.games;) {
+                std::vector<position_record_t> game_records;
+                play_game(config, game, game_records);
+                if (game_records.empty()) continue;
+                const int result = game_records.front().result;
+                wins[result == 1 ? 1 : result == -1 ? 2 : 0]++;
+                std::lock_guard<std::mutex> lock(records_mtx);
+                records.insert(records.end(), game_records.begin(), game_records.end());
+            }
+        });
+    }
+    for (auto &thread : threads) thread.join();
+
+    std::cout << "games: " << config.games << ", player 1 wins: " << wins[1] << ", player 2 wins: " << wins[2]
+              << ", draws: " << wins[0] << "\npositions: " << records.size() << std::endl;
+    if (!write_positions(config.out, records)) {
+        std::cerr << "[ERROR]: can not write " << config.out << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+struct fit_config_t {
+    std::string in{"positions.bin"};
+    std::string out{"eval_weights.hpp"};
+    int iterations{500};
+    double rate{1.0};
+    unsigned threads_cnt{std::max(std::thread::hardware_concurrency(), 1u)};
+};
+
+// a position as the weights it adds, the first PIECE_CNT for player 1 and the rest subtracted for player 2
+struct sample_t {
+    std::uint8_t weights[2 * PIECE_CNT];
+    float target; // 1 for a win of player 1, 0 for a loss, 0.5 for a draw
+};
+
+static sample_t to_sample(const position_record_t &record) {
+    sample_t sample{};
+    for (int player = 0; player < 2; player++) {
+        for (int i = 0; i < PIECE_CNT; i++) {
+            const std::uint8_t value = record.cells[player][i];
+            int cell = value & ~SPECIAL_BIT;
+            // player 2 reads the tables of player 1 from the opposite corner
+            if (player == 1) cell = CELL_CNT - 1 - cell;
+            sample.weights[player * PIECE_CNT + i] = static_cast<std::uint8_t>(
+                    (value & SPECIAL_BIT ? WEIGHT_TABLE_SIZE : 0) + weight_cell(cell));
+        }
+    }
+    sample.target = (record.result + 1) * 0.5f;
+    return sample;
+}
+
+static inline double evaluate_sample(const sample_t &sample, const double *w) {
+    double score = 0;
+    for (int i = 0; i < PIECE_CNT; i++) score += w[sample.weights[i]];
+    for (int i = PIECE_CNT; i < 2 * PIECE_CNT; i++) score -= w[sample.weights[i]];
+    return score;
+}
+
+static inline double sigmoid(double k, double score) {
+    return 1 / (1 + std::exp(-k * score));
+}
+
+// mean squared error between the results and the win probability of the score, and its gradient if asked
+static double loss(const std::vector<sample_t> &samples, const std::vector<double> &w, double k,
+                   unsigned threads_cnt, std::vector<double> *gradient = nullptr) {
+    std::vector<double> losses(threads_cnt, 0);
+    std::vector<std::vector<double>> gradients(gradient ? threads_cnt : 0, std::vector<double>(WEIGHT_CNT, 0));
+    parallel_chunks(samples.size(), threads_cnt, [&](unsigned t, std::size_t begin, std::size_t end) {
+        double sum = 0;
+        for (std::size_t i = begin; i < end; i++) {
+            const auto &sample = samples[i];
+            const double s = sigmoid(k, evaluate_sample(sample, w.data()));
+            const double error = sample.target - s;
+            sum += error * error;
+            if (!gradient) continue;
+            const double g = -2 * error * s * (1 - s) * k;
+            for (int j = 0; j < PIECE_CNT; j++) gradients[t][sample.weights[j]] += g;
+            for (int j = PIECE_CNT; j < 2 * PIECE_CNT; j++) gradients[t][sample.weights[j]] -= g;
+        }
+        losses[t] = sum;
+    });
+    const double n = std::max<std::size_t>(samples.size(), 1);
+    if (gradient) {
+        gradient->assign(WEIGHT_CNT, 0);
+        for (auto &g : gradients) for (int j = 0; j < WEIGHT_CNT; j++) (*gradient)[j] += g[j] / n;
+    }
+    double sum = 0;
+    for (double l : losses) sum += l;
+    return sum / n;
+}
+
+// the scale of the sigmoid that fits the current weights best, by golden section search on its log
+static double fit_scale(const std::vector<sample_t> &samples, const std::vector<double> &w, unsigned threads_cnt) {
+    const double ratio = (std::sqrt(5.0) - 1) / 2;
+    double lo = std::log(1e-5), hi = std::log(1e-1);
+    double a = hi - ratio * (hi - lo), b = lo + ratio * (hi - lo);
+    double la = loss(samples, w, std::exp(a), threads_cnt), lb = loss(samples, w, std::exp(b), threads_cnt);
+    for (int i = 0; i < 40; i++) {
+        if (la < lb) {
+            hi = b, b = a, lb = la;
+            a = hi - ratio * (hi - lo);
+            la = loss(samples, w, std::exp(a), threads_cnt);
+        } else {
+            lo = a, a = b, la = lb;
+            b = lo + ratio * (hi - lo);
+            lb = loss(samples, w, std::exp(b), threads_cnt);
+        }
+    }
+    return std::exp((lo + hi) / 2);
+}
+
+static void write_table(std::ostream &out, const char *name, const std::vector<double> &w, int offset) {
+    out << "static constexpr int " << name << "[" << WEIGHT_SIZE << "][" << WEIGHT_SIZE << "] = {\n";
+    for (int x = 0; x < WEIGHT_SIZE; x++) {
+        out << "        {";
+        for (int y = 0; y < WEIGHT_SIZE; y++) {
+            const long value = std::lround(w[offset + x * WEIGHT_SIZE + y]);
+            if (y == WEIGHT_SIZE - 1) {
+                out << value << "},\n";
+                continue;
+            }
+            const std::string item = std::to_string(value) + ",";
+            out << item << std::string(std::max<std::size_t>(5, item.size() + 1) - item.size(), ' ');
+        }
+    }
+    out << "};\n";
+}
+
+static bool write_weights(const std::string &path, const std::vector<double> &w, std::size_t samples_cnt,
+                          double final_loss) {
+    std::ofstream out(path);
+    out << "//\n"
+           "// Generated by tune fit from " << samples_cnt << " positions, loss " << std::setprecision(6)
+        << final_loss << ".\n"
+           "//\n"
+           "// piece-square weights of the evaluation, seen from player 1 moving to the (0, 0) corner.\n"
+           "// score7 is for normal pieces, score3 for special pieces. `tune fit` writes a replacement of this file.\n"
+           "//\n\n"
+           "#ifndef PLUGIN_EVAL_WEIGHTS_HPP\n"
+           "#define PLUGIN_EVAL_WEIGHTS_HPP\n\n";
+    write_table(out, "score7", w, 0);
+    out << "\n";
+    write_table(out, "score3", w, WEIGHT_TABLE_SIZE);
+    out << "\n#endif //PLUGIN_EVAL_WEIGHTS_HPP\n";
+    return out.good();
+}
+
+// Texel tuning: fit the sigmoid scale to the current tables once, then descend on the weights with adam.
+// the search only sees score differences, so weights of cells no position reaches keep their values.
+static int run_fit(const fit_config_t &config) {
+    std::vector<position_record_t> records;
+    if (!read_positions(config.in, records)) {
+        std::cerr << "[ERROR]: can not read positions from " << config.in << std::endl;
+        return 1;
+    }
+    std::vector<sample_t> samples(records.size());
+    parallel_chunks(records.size(), config.threads_cnt, [&](unsigned, std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; i++) samples[i] = to_sample(records[i]);
+    });
+    records.clear();
+    records.shrink_to_fit();
+
+    std::vector<double> w(WEIGHT_CNT);
+    for (int cell = 0; cell < WEIGHT_TABLE_SIZE; cell++) {
+        w[cell] = score7[cell / WEIGHT_SIZE][cell % WEIGHT_SIZE];
+        w[WEIGHT_TABLE_SIZE + cell] = score3[cell / WEIGHT_SIZE][cell % WEIGHT_SIZE];
+    }
+    const double k = fit_scale(samples, w, config.threads_cnt);
+    std::cout << "positions: " << samples.size() << ", scale: " << k << ", loss: "
+              << loss(samples, w, k, config.threads_cnt) << std::endl;
+
+    const double beta1 = 0.9, beta2 = 0.999, eps = 1e-12;
+    std::vector<double> gradient, m(WEIGHT_CNT, 0), v(WEIGHT_CNT, 0);
+    for (int iteration = 1; iteration <= config.iterations; iteration++) {
+        const double l = loss(samples, w, k, config.threads_cnt, &gradient);
+        for (int j = 0; j < WEIGHT_CNT; j++) {
+            m[j] = beta1 * m[j] + (1 - beta1) * gradient[j];
+            v[j] = beta2 * v[j] + (1 - beta2) * gradient[j] * gradient[j];
+            const double m_hat = m[j] / (1 - std::pow(beta1, iteration));
+            const double v_hat = v[j] / (1 - std::pow(beta2, iteration));
+            w[j] -= config.rate * m_hat / (std::sqrt(v_hat) + eps);
+        }
+        if (iteration % 50 == 0 || iteration == config.iterations) {
+            std::cout << "iteration " << iteration << ", loss: " << l << std::endl;
+        }
+    }
+
+    for (double &weight : w) weight = std::round(weight);
+    const double final_loss = loss(samples, w, k, config.threads_cnt);
+    std::cout << "rounded loss: " << final_loss << std::endl;
+    if (!write_weights(config.out, w, samples.size(), final_loss)) {
+        std::cerr << "[ERROR]: can not write " << config.out << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+static int usage(const char *name) {
+    std::cout << "usage: " << name << " gen [--out file, default=positions.bin] [--games n, default=1000]"
+              << " [--depth n, default=2] [--opening-plies n, default=8] [--threads n, default=cores] [--seed n]\n"
+              << "       " << name << " fit [--in file, default=positions.bin] [--out file, default=eval_weights.hpp]"
+              << " [--iterations n, default=500] [--rate x, default=1] [--threads n, default=cores]" << std::endl;
+    return -1;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) return usage(argv[0]);
+    if (strcmp("gen", argv[1]) == 0) {
+        gen_config_t config;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp("--out", argv[i]) == 0 && i + 1 < argc) config.out = argv[++i];
+            else if (strcmp("--games", argv[i]) == 0 && i + 1 < argc) config.games = std::max(std::atoi(argv[++i]), 1);
+            else if (strcmp("--depth", argv[i]) == 0 && i + 1 < argc) config.depth = std::max(std::atoi(argv[++i]), 1);
+            else if (strcmp("--opening-plies", argv[i]) == 0 && i + 1 < argc)
+                config.opening_plies = std::max(std::atoi(argv[++i]), 0);
+            else if (strcmp("--threads", argv[i]) == 0 && i + 1 < argc)
+                config.threads_cnt = std::max(std::atoi(argv[++i]), 1);
+            else if (strcmp("--seed", argv[i]) == 0 && i + 1 < argc) config.seed = (unsigned) std::atoll(argv[++i]);
+            else return usage(argv[0]);
+        }
+        return run_gen(config);
+    }
+    if (strcmp("fit", argv[1]) == 0) {
+        fit_config_t config;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp("--in", argv[i]) == 0 && i + 1 < argc) config.in = argv[++i];
+            else if (strcmp("--out", argv[i]) == 0 && i + 1 < argc) config.out = argv[++i];
+            else if (strcmp("--iterations", argv[i]) == 0 && i + 1 < argc)
+                config.iterations = std::max(std::atoi(argv[++i]), 0);
+            else if (strcmp("--rate", argv[i]) == 0 && i + 1 < argc) config.rate = std::atof(argv[++i]);
+            else if (strcmp("--threads", argv[i]) == 0 && i + 1 < argc)
+                config.threads_cnt = std::max(std::atoi(argv[++i]), 1);
+            else return usage(argv[0]);
+        }
+        return run_fit(config);
+    }
+    return usage(argv[0]);
+}